@@ -0,0 +1,50 @@
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTextStream>
+#include "ImageProcessor.h"
+#include "ScratchPool.h"
+
+// Times ImageProcessor::applyBlur across radii. The running-sum blur should
+// cost about the same at every radius.
+//
+//   BlurBenchmark [width height]
+int main(int argc, char *argv[])
+{
+    int width = 6000;
+    int height = 4000;
+    if (argc >= 3) {
+        width = QString(argv[1]).toInt();
+        height = QString(argv[2]).toInt();
+    }
+    if (width <= 0 || height <= 0) return 1;
+    
+    // Noise, so no radius gets an easy input.
+    QImage source(width, height, ImageProcessor::WorkingFormat);
+    quint32 seed = 12345;
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(source.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            line[x] = seed | 0xff000000u;
+        }
+    }
+    
+    QTextStream out(stdout);
+    out << "applyBlur " << width << "x" << height << ", best of 3\n";
+    const int radii[] = {1, 2, 5, 10, 20, 50, 100};
+    QImage result;
+    for (int radius : radii) {
+        qint64 best = -1;
+        for (int run = 0; run < 3; ++run) {
+            QElapsedTimer timer;
+            timer.start();
+            ImageProcessor::applyBlur(source, result, radius);
+            const qint64 elapsed = timer.elapsed();
+            if (best < 0 || elapsed < best) best = elapsed;
+        }
+        out << "  radius " << radius << ": " << best << " ms\n";
+        out.flush();
+    }
+    ScratchPool::release(result);
+    return 0;
+}
@@ -44,6 +44,8 @@ void AdjustmentPanel::setupUi()
         connect(slider, &QSlider::valueChanged, spin, &QSpinBox::setValue);
         connect(spin, QOverload<int>::of(&QSpinBox::valueChanged), slider, &QSlider::setValue);
         connect(slider, &QSlider::valueChanged, this, signal);
+        connect(slider, &QSlider::sliderPressed, this, &AdjustmentPanel::interactionStarted);
+        connect(slider, &QSlider::sliderReleased, this, &AdjustmentPanel::interactionFinished);
         
         groupLayout->addLayout(row);
     };
@@ -23,6 +23,8 @@ signals:
     void contrastChanged(int value);
     void saturationChanged(int value);
     void resetRequested();
+    void interactionStarted();
+    void interactionFinished();
 
 private:
     void setupUi();
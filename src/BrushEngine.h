@@ -0,0 +1,47 @@
+#ifndef BRUSHENGINE_H
+#define BRUSHENGINE_H
+
+#include <QImage>
+#include <QColor>
+#include <QHash>
+#include <QPointF>
+#include <QRect>
+#include <QVector>
+
+struct BrushSettings {
+    int size = 5;           // dab diameter in pixels
+    int hardness = 100;     // 0-100, share of the radius at full coverage
+    int spacing = 25;       // 1-200, dab distance in percent of the diameter
+    int flow = 100;         // 1-100, opacity of a single dab
+    QColor color = Qt::black;
+    bool eraser = false;
+};
+
+// Paints strokes by stamping anti-aliased round dabs at even spacing along
+// the sampled path. Dab masks are built once per size/hardness and reused;
+// compositing goes straight into the ARGB32 scanlines through PixelKernels.
+class BrushEngine
+{
+public:
+    BrushEngine();
+    
+    void beginStroke(const BrushSettings &settings);
+    
+    // Image-space rectangle that strokeTo() with these points may touch.
+    QRect strokeBounds(const QVector<QPoint> &points) const;
+    // Continues the stroke through `points`; the first point of a stroke
+    // gets a dab of its own.
+    void strokeTo(QImage &target, const QVector<QPoint> &points);
+
+private:
+    const QVector<quint8> &dabMask(int diameter, int hardness);
+    void stamp(QImage &target, const QPointF &center);
+    
+    BrushSettings m_settings;
+    QPointF m_last;
+    double m_carry;
+    bool m_started;
+    QHash<int, QVector<quint8>> m_masks;
+};
+
+#endif // BRUSHENGINE_H
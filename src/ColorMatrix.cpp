@@ -0,0 +1,168 @@
+#include "ColorMatrix.h"
+#include <QtMath>
+
+namespace {
+
+const double LumaWeights[3] = {0.299, 0.587, 0.114};
+
+ColorMatrix lumaBlend(double keep, double luma)
+{
+    double rows[4][5] = {};
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            rows[r][c] = LumaWeights[c] * luma + (r == c ? keep : 0);
+        }
+    }
+    rows[3][3] = 1;
+    return ColorMatrix::fromRows(rows);
+}
+
+} // namespace
+
+ColorMatrix::ColorMatrix()
+{
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 5; ++c) {
+            m_m[r][c] = (r == c) ? One : 0;
+        }
+    }
+}
+
+ColorMatrix ColorMatrix::fromRows(const double rows[4][5])
+{
+    ColorMatrix m;
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 5; ++c) {
+            m.m_m[r][c] = static_cast<qint32>(qRound64(rows[r][c] * One));
+        }
+    }
+    return m;
+}
+
+ColorMatrix ColorMatrix::brightness(int delta)
+{
+    return channelOffset(delta, delta, delta);
+}
+
+ColorMatrix ColorMatrix::contrast(double factor)
+{
+    double offset = 128 * (1 - factor);
+    const double rows[4][5] = {
+        {factor, 0, 0, 0, offset},
+        {0, factor, 0, 0, offset},
+        {0, 0, factor, 0, offset},
+        {0, 0, 0, 1, 0}
+    };
+    return fromRows(rows);
+}
+
+ColorMatrix ColorMatrix::saturation(double factor)
+{
+    return lumaBlend(factor, 1 - factor);
+}
+
+ColorMatrix ColorMatrix::grayscale(double amount)
+{
+    return lumaBlend(1 - amount, amount);
+}
+
+ColorMatrix ColorMatrix::sepia(double amount)
+{
+    static const double tone[3][3] = {
+        {0.393, 0.769, 0.189},
+        {0.349, 0.686, 0.168},
+        {0.272, 0.534, 0.131}
+    };
+    double rows[4][5] = {};
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            rows[r][c] = tone[r][c] * amount + (r == c ? 1 - amount : 0);
+        }
+    }
+    rows[3][3] = 1;
+    return fromRows(rows);
+}
+
+ColorMatrix ColorMatrix::invert()
+{
+    const double rows[4][5] = {
+        {-1, 0, 0, 0, 255},
+        {0, -1, 0, 0, 255},
+        {0, 0, -1, 0, 255},
+        {0, 0, 0, 1, 0}
+    };
+    return fromRows(rows);
+}
+
+ColorMatrix ColorMatrix::channelOffset(int dr, int dg, int db)
+{
+    ColorMatrix m;
+    m.m_m[0][4] = dr * One;
+    m.m_m[1][4] = dg * One;
+    m.m_m[2][4] = db * One;
+    return m;
+}
+
+ColorMatrix ColorMatrix::operator*(const ColorMatrix &other) const
+{
+    ColorMatrix result;
+    const qint64 round = One / 2;
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 5; ++c) {
+            qint64 sum = 0;
+            for (int k = 0; k < 4; ++k) {
+                sum += static_cast<qint64>(m_m[r][k]) * other.m_m[k][c];
+            }
+            sum = (sum + round) >> Shift;
+            if (c == 4) sum += m_m[r][4];
+            result.m_m[r][c] = static_cast<qint32>(sum);
+        }
+    }
+    return result;
+}
+
+bool ColorMatrix::operator==(const ColorMatrix &other) const
+{
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 5; ++c) {
+            if (m_m[r][c] != other.m_m[r][c]) return false;
+        }
+    }
+    return true;
+}
+
+bool ColorMatrix::isIdentity() const
+{
+    return *this == ColorMatrix();
+}
+
+bool ColorMatrix::isAlphaPreserving() const
+{
+    return m_m[3][0] == 0 && m_m[3][1] == 0 && m_m[3][2] == 0 && m_m[3][3] == One && m_m[3][4] == 0;
+}
+
+bool ColorMatrix::isTranslation() const
+{
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            if (m_m[r][c] != ((r == c) ? One : 0)) return false;
+        }
+        if (m_m[r][4] % One != 0) return false;
+    }
+    return m_m[3][4] == 0;
+}
+
+bool ColorMatrix::isInvert() const
+{
+    return *this == invert();
+}
+
+bool ColorMatrix::fitsInt16() const
+{
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            if (m_m[r][c] < -32768 || m_m[r][c] > 32767) return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef COLORMATRIX_H
+#define COLORMATRIX_H
+
+#include <QtGlobal>
+
+// 4x5 affine color transform in 4.12 fixed point. Rows produce R, G, B, A;
+// columns weight R, G, B, A and the last column is a constant offset in
+// 0-255 units (also scaled by One). Pixels are clamped once, after the
+// whole matrix has been applied.
+class ColorMatrix
+{
+public:
+    static const int Shift = 12;
+    static const int One = 1 << Shift;
+
+    ColorMatrix();
+
+    static ColorMatrix fromRows(const double rows[4][5]);
+    static ColorMatrix brightness(int delta);
+    static ColorMatrix contrast(double factor);
+    static ColorMatrix saturation(double factor);
+    static ColorMatrix grayscale(double amount);
+    static ColorMatrix sepia(double amount);
+    static ColorMatrix invert();
+    static ColorMatrix channelOffset(int dr, int dg, int db);
+
+    qint32 at(int row, int column) const { return m_m[row][column]; }
+
+    ColorMatrix operator*(const ColorMatrix &other) const;
+    ColorMatrix then(const ColorMatrix &next) const { return next * *this; }
+    bool operator==(const ColorMatrix &other) const;
+    bool operator!=(const ColorMatrix &other) const { return !(*this == other); }
+
+    bool isIdentity() const;
+    bool isAlphaPreserving() const;
+    bool isTranslation() const;
+    bool isInvert() const;
+    bool fitsInt16() const;
+
+private:
+    qint32 m_m[4][5];
+};
+
+#endif // COLORMATRIX_H
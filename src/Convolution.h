@@ -0,0 +1,109 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <QImage>
+#include <QVector>
+
+enum class BorderMode {
+    Clamp,
+    Mirror,
+    Wrap
+};
+
+// Square convolution over 32-bit ARGB scanlines. The kernel size is a template
+// parameter, and the weights come from any type with an at(row, column)
+// method; when that method is constexpr the compiler folds the coefficients
+// (and drops the zero taps). Each call keeps a rolling window of Size row
+// pointers, so only border pixels pay for coordinate remapping.
+namespace Convolution {
+
+inline int borderIndex(int i, int n, BorderMode mode)
+{
+    if (i >= 0 && i < n) return i;
+    switch (mode) {
+    case BorderMode::Clamp:
+        return i < 0 ? 0 : n - 1;
+    case BorderMode::Mirror:
+        if (n == 1) return 0;
+        while (i < 0 || i >= n) i = (i < 0) ? -i : 2 * (n - 1) - i;
+        return i;
+    case BorderMode::Wrap:
+        return ((i % n) + n) % n;
+    }
+    return 0;
+}
+
+// Runtime weights for user-defined kernels.
+template <int Size>
+struct Weights
+{
+    int values[Size][Size];
+
+    int at(int row, int column) const { return values[row][column]; }
+};
+
+template <int Size, bool Interior, typename Kernel>
+inline void accumulate(const QRgb *const *rows, int x, int width, const Kernel &kernel, BorderMode border,
+                       int &r, int &g, int &b)
+{
+    const int radius = Size / 2;
+    for (int dy = 0; dy < Size; ++dy) {
+        for (int dx = 0; dx < Size; ++dx) {
+            const int k = kernel.at(dy, dx);
+            if (k == 0) continue;
+            const int sx = Interior ? x + dx - radius : borderIndex(x + dx - radius, width, border);
+            const QRgb p = rows[dy][sx];
+            r += qRed(p) * k;
+            g += qGreen(p) * k;
+            b += qBlue(p) * k;
+        }
+    }
+}
+
+// Convolves rows [y0, y1) of source into resultBits. Finish receives the
+// weighted R, G and B sums plus the centre pixel and returns the output pixel.
+template <int Size, typename Kernel, typename Finish>
+void convolveRows(const QImage &source, uchar *resultBits, qsizetype resultStride, int y0, int y1,
+                  const Kernel &kernel, BorderMode border, Finish finish)
+{
+    static_assert(Size % 2 == 1, "convolution kernels must have odd size");
+    const int radius = Size / 2;
+    const int width = source.width();
+    const int height = source.height();
+    auto line = [&](int y) {
+        return reinterpret_cast<const QRgb*>(source.constScanLine(borderIndex(y, height, border)));
+    };
+    
+    const QRgb *rows[Size];
+    for (int k = 0; k < Size; ++k) rows[k] = line(y0 + k - radius);
+    
+    const int interiorBegin = qMin(radius, width);
+    const int interiorEnd = qMax(interiorBegin, width - radius);
+    for (int y = y0; y < y1; ++y) {
+        QRgb *out = reinterpret_cast<QRgb*>(resultBits + y * resultStride);
+        const QRgb *centre = rows[radius];
+        int x = 0;
+        for (; x < interiorBegin; ++x) {
+            int r = 0, g = 0, b = 0;
+            accumulate<Size, false>(rows, x, width, kernel, border, r, g, b);
+            out[x] = finish(r, g, b, centre[x]);
+        }
+        for (; x < interiorEnd; ++x) {
+            int r = 0, g = 0, b = 0;
+            accumulate<Size, true>(rows, x, width, kernel, border, r, g, b);
+            out[x] = finish(r, g, b, centre[x]);
+        }
+        for (; x < width; ++x) {
+            int r = 0, g = 0, b = 0;
+            accumulate<Size, false>(rows, x, width, kernel, border, r, g, b);
+            out[x] = finish(r, g, b, centre[x]);
+        }
+        
+        for (int k = 0; k + 1 < Size; ++k) rows[k] = rows[k + 1];
+        rows[Size - 1] = line(y + radius + 1);
+    }
+}
+
+} // namespace Convolution
+
+#endif // CONVOLUTION_H
@@ -0,0 +1,66 @@
+#include "Fft.h"
+#include <QtMath>
+#include <utility>
+
+Fft::Fft(int size)
+    : m_size(size)
+    , m_twiddles(size / 2)
+    , m_bitReverse(size)
+{
+    for (int i = 0; i < size / 2; ++i) {
+        double angle = -2 * M_PI * i / size;
+        m_twiddles[i] = std::complex<float>(static_cast<float>(qCos(angle)), static_cast<float>(qSin(angle)));
+    }
+    int bits = 0;
+    while ((1 << bits) < size) ++bits;
+    for (int i = 0; i < size; ++i) {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b) {
+            if (i & (1 << b)) reversed |= 1 << (bits - 1 - b);
+        }
+        m_bitReverse[i] = reversed;
+    }
+}
+
+void Fft::transform(std::complex<float> *data, bool inverse) const
+{
+    for (int i = 0; i < m_size; ++i) {
+        int j = m_bitReverse[i];
+        if (i < j) std::swap(data[i], data[j]);
+    }
+    
+    for (int length = 2; length <= m_size; length <<= 1) {
+        const int half = length / 2;
+        const int step = m_size / length;
+        for (int start = 0; start < m_size; start += length) {
+            for (int k = 0; k < half; ++k) {
+                const std::complex<float> w = m_twiddles[k * step];
+                const float wi = inverse ? -w.imag() : w.imag();
+                const std::complex<float> b = data[start + k + half];
+                const std::complex<float> odd(b.real() * w.real() - b.imag() * wi,
+                                              b.real() * wi + b.imag() * w.real());
+                data[start + k + half] = data[start + k] - odd;
+                data[start + k] += odd;
+            }
+        }
+    }
+}
+
+void Fft::transform2D(std::complex<float> *data, bool inverse) const
+{
+    for (int row = 0; row < m_size; ++row) transform(data + row * m_size, inverse);
+    
+    QVector<std::complex<float>> column(m_size);
+    for (int col = 0; col < m_size; ++col) {
+        for (int row = 0; row < m_size; ++row) column[row] = data[row * m_size + col];
+        transform(column.data(), inverse);
+        for (int row = 0; row < m_size; ++row) data[row * m_size + col] = column[row];
+    }
+}
+
+int Fft::nextPowerOfTwo(int n)
+{
+    int size = 1;
+    while (size < n) size <<= 1;
+    return size;
+}
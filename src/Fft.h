@@ -0,0 +1,28 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <QVector>
+#include <complex>
+
+// Iterative radix-2 complex FFT for power-of-two sizes. Transforms are
+// unnormalized; the inverse divides by nothing, so a forward/inverse round
+// trip scales by size (or size * size in 2-D).
+class Fft
+{
+public:
+    explicit Fft(int size);
+    
+    int size() const { return m_size; }
+    
+    void transform(std::complex<float> *data, bool inverse) const;
+    void transform2D(std::complex<float> *data, bool inverse) const;
+    
+    static int nextPowerOfTwo(int n);
+
+private:
+    int m_size;
+    QVector<std::complex<float>> m_twiddles;
+    QVector<int> m_bitReverse;
+};
+
+#endif // FFT_H
@@ -21,6 +21,11 @@ void FilterPanel::setupUi()
     m_filterList->addItem("冷色");
     m_filterList->addItem("锐化");
     m_filterList->addItem("模糊");
+    m_filterList->addItem("高斯模糊");
+    m_filterList->addItem("USM 锐化");
+    m_filterList->addItem("镜头模糊");
+    m_filterList->addItem("动感模糊");
+    m_filterList->addItem("中值去噪");
     m_filterList->addItem("浮雕");
     m_filterList->addItem("反相");
     m_filterList->setCurrentRow(0);
@@ -36,6 +41,32 @@ void FilterPanel::setupUi()
     m_intensitySlider->setValue(100);
     layout->addWidget(m_intensitySlider);
     
+    m_radiusLabel = new QLabel("半径: 5 px");
+    layout->addWidget(m_radiusLabel);
+    
+    m_radiusSlider = new QSlider(Qt::Horizontal);
+    m_radiusSlider->setRange(1, 100);
+    m_radiusSlider->setValue(5);
+    layout->addWidget(m_radiusSlider);
+    
+    m_thresholdLabel = new QLabel("阈值: 0");
+    layout->addWidget(m_thresholdLabel);
+    
+    m_thresholdSlider = new QSlider(Qt::Horizontal);
+    m_thresholdSlider->setRange(0, 255);
+    m_thresholdSlider->setValue(0);
+    layout->addWidget(m_thresholdSlider);
+    
+    m_angleLabel = new QLabel("角度: 0°");
+    layout->addWidget(m_angleLabel);
+    
+    m_angleSlider = new QSlider(Qt::Horizontal);
+    m_angleSlider->setRange(0, 180);
+    m_angleSlider->setValue(0);
+    layout->addWidget(m_angleSlider);
+    
+    updateControls("");
+    
     connect(m_filterList, &QListWidget::currentTextChanged, this, [this](const QString &text) {
         QString filter = "";
         if (text == "灰度") filter = "grayscale";
@@ -45,8 +76,14 @@ void FilterPanel::setupUi()
         else if (text == "冷色") filter = "cool";
         else if (text == "锐化") filter = "sharpen";
         else if (text == "模糊") filter = "blur";
+        else if (text == "高斯模糊") filter = "gaussian";
+        else if (text == "USM 锐化") filter = "unsharp";
+        else if (text == "镜头模糊") filter = "lens";
+        else if (text == "动感模糊") filter = "motion";
+        else if (text == "中值去噪") filter = "median";
         else if (text == "浮雕") filter = "emboss";
         else if (text == "反相") filter = "invert";
+        updateControls(filter);
         emit filterSelected(filter);
     });
     
@@ -55,6 +92,26 @@ void FilterPanel::setupUi()
         emit intensityChanged(value);
     });
     
+    connect(m_radiusSlider, &QSlider::valueChanged, this, [this](int value) {
+        m_radiusLabel->setText(QString("半径: %1 px").arg(value));
+        emit radiusChanged(value);
+    });
+    
+    connect(m_thresholdSlider, &QSlider::valueChanged, this, [this](int value) {
+        m_thresholdLabel->setText(QString("阈值: %1").arg(value));
+        emit thresholdChanged(value);
+    });
+    
+    connect(m_angleSlider, &QSlider::valueChanged, this, [this](int value) {
+        m_angleLabel->setText(QString("角度: %1°").arg(value));
+        emit angleChanged(value);
+    });
+    
+    for (QSlider *slider : {m_intensitySlider, m_radiusSlider, m_thresholdSlider, m_angleSlider}) {
+        connect(slider, &QSlider::sliderPressed, this, &FilterPanel::interactionStarted);
+        connect(slider, &QSlider::sliderReleased, this, &FilterPanel::interactionFinished);
+    }
+    
     layout->addStretch();
 }
 
@@ -68,6 +125,11 @@ QString FilterPanel::currentFilter() const
     if (text == "冷色") return "cool";
     if (text == "锐化") return "sharpen";
     if (text == "模糊") return "blur";
+    if (text == "高斯模糊") return "gaussian";
+    if (text == "USM 锐化") return "unsharp";
+    if (text == "镜头模糊") return "lens";
+    if (text == "动感模糊") return "motion";
+    if (text == "中值去噪") return "median";
     if (text == "浮雕") return "emboss";
     if (text == "反相") return "invert";
     return "";
@@ -78,8 +140,43 @@ int FilterPanel::filterIntensity() const
     return m_intensitySlider->value();
 }
 
+int FilterPanel::filterRadius() const
+{
+    return m_radiusSlider->value();
+}
+
+int FilterPanel::filterThreshold() const
+{
+    return m_thresholdSlider->value();
+}
+
+int FilterPanel::filterAngle() const
+{
+    return m_angleSlider->value();
+}
+
 void FilterPanel::resetToDefault()
 {
     m_filterList->setCurrentRow(0);
     m_intensitySlider->setValue(100);
+    m_radiusSlider->setValue(5);
+    m_thresholdSlider->setValue(0);
+    m_angleSlider->setValue(0);
+}
+
+void FilterPanel::updateControls(const QString &filterName)
+{
+    bool usesRadius = (filterName == "gaussian" || filterName == "unsharp" || filterName == "lens"
+                       || filterName == "motion" || filterName == "median");
+    bool usesIntensity = !usesRadius || filterName == "unsharp";
+    bool usesThreshold = (filterName == "unsharp");
+    bool usesAngle = (filterName == "motion");
+    m_intensityLabel->setVisible(usesIntensity);
+    m_intensitySlider->setVisible(usesIntensity);
+    m_radiusLabel->setVisible(usesRadius);
+    m_radiusSlider->setVisible(usesRadius);
+    m_thresholdLabel->setVisible(usesThreshold);
+    m_thresholdSlider->setVisible(usesThreshold);
+    m_angleLabel->setVisible(usesAngle);
+    m_angleSlider->setVisible(usesAngle);
 }
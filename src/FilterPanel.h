@@ -15,19 +15,34 @@ public:
     
     QString currentFilter() const;
     int filterIntensity() const;
+    int filterRadius() const;
+    int filterThreshold() const;
+    int filterAngle() const;
     void resetToDefault();
 
 signals:
     void filterSelected(const QString &filterName);
     void intensityChanged(int value);
+    void radiusChanged(int value);
+    void thresholdChanged(int value);
+    void angleChanged(int value);
     void applyClicked();
+    void interactionStarted();
+    void interactionFinished();
 
 private:
     void setupUi();
+    void updateControls(const QString &filterName);
     
     QListWidget *m_filterList;
     QSlider *m_intensitySlider;
     QLabel *m_intensityLabel;
+    QSlider *m_radiusSlider;
+    QLabel *m_radiusLabel;
+    QSlider *m_thresholdSlider;
+    QLabel *m_thresholdLabel;
+    QSlider *m_angleSlider;
+    QLabel *m_angleLabel;
 };
 
 #endif // FILTERPANEL_H
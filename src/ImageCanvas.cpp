@@ -1,5 +1,8 @@
 #include "ImageCanvas.h"
 #include "ImageProcessor.h"
+#include "TileScheduler.h"
+#include "ScratchPool.h"
+#include "UndoStore.h"
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QKeyEvent>
@@ -8,46 +11,65 @@
 #include <QInputDialog>
 #include <QFontDialog>
 #include <QColorDialog>
+#include <QScreen>
+#include <QScrollBar>
+#include <QResizeEvent>
 #include <QtMath>
+#include <cstring>
 
 ImageCanvas::ImageCanvas(QWidget *parent)
-    : QWidget(parent)
+    : QAbstractScrollArea(parent)
     , m_tool(ToolType::Select)
     , m_drawing(false)
     , m_cropMode(false)
     , m_brushSize(5)
     , m_brushColor(Qt::black)
     , m_eraserSize(20)
-    , m_brightness(100)
-    , m_contrast(100)
-    , m_saturation(100)
-    , m_filterIntensity(100)
+    , m_brushHardness(100)
+    , m_brushSpacing(25)
+    , m_brushFlow(100)
     , m_selectedTextIndex(-1)
     , m_textInputMode(false)
     , m_zoomFactor(1.0)
     , m_modified(false)
+    , m_previewScale(1.0)
+    , m_frameIsDocument(false)
+    , m_rendering(false)
+    , m_geometryGeneration(0)
+    , m_deliveredRevision(0)
+    , m_graph(&m_image)
 {
     setMinimumSize(200, 200);
-    setMouseTracking(true);
+    viewport()->setMouseTracking(true);
     setFocusPolicy(Qt::StrongFocus);
+    m_renderPool.setMaxThreadCount(1);
+    
+    m_strokeTimer.setSingleShot(true);
+    m_strokeTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_strokeTimer, &QTimer::timeout, this, &ImageCanvas::flushStroke);
+}
+
+ImageCanvas::~ImageCanvas()
+{
+    cancelRender();
+    m_renderPool.waitForDone();
 }
 
 bool ImageCanvas::loadImage(const QString &fileName)
 {
     QImage loaded;
     if (!loaded.load(fileName)) return false;
+    // In place where the pixel size allows, so the file is never held twice.
+    loaded.convertTo(ImageProcessor::WorkingFormat);
     
-    m_image = loaded.convertToFormat(QImage::Format_ARGB32);
-    m_baseImage = m_image.copy();
-    m_adjustedImage = m_image.copy();
-    m_displayImage = m_image.copy();
     m_undoStack.clear();
     m_redoStack.clear();
+    editDocument([&]() { m_image = std::move(loaded); });
     m_textItems.clear();
     m_modified = false;
     
     zoomFit();
-    update();
+    viewport()->update();
     return true;
 }
 
@@ -55,16 +77,13 @@ bool ImageCanvas::loadImage(const QImage &image)
 {
     if (image.isNull()) return false;
     
-    m_image = image.convertToFormat(QImage::Format_ARGB32);
-    m_baseImage = m_image.copy();
-    m_adjustedImage = m_image.copy();
-    m_displayImage = m_image.copy();
+    editDocument([&]() { m_image = image.convertToFormat(ImageProcessor::WorkingFormat); });
     m_undoStack.clear();
     m_redoStack.clear();
     m_textItems.clear();
     m_modified = false;
     
-    update();
+    viewport()->update();
     return true;
 }
 
@@ -73,72 +92,81 @@ void ImageCanvas::setTool(ToolType tool)
     m_tool = tool;
     m_cropMode = (tool == ToolType::Crop);
     if (m_cropMode) m_cropRect = QRect();
-    update();
+    viewport()->update();
 }
 
 void ImageCanvas::setBrushSize(int size) { m_brushSize = qBound(1, size, 100); }
 void ImageCanvas::setBrushColor(const QColor &color) { m_brushColor = color; }
 void ImageCanvas::setEraserSize(int size) { m_eraserSize = qBound(5, size, 200); }
+void ImageCanvas::setBrushHardness(int hardness) { m_brushHardness = qBound(0, hardness, 100); }
+void ImageCanvas::setBrushSpacing(int spacing) { m_brushSpacing = qBound(1, spacing, 200); }
+void ImageCanvas::setBrushFlow(int flow) { m_brushFlow = qBound(1, flow, 100); }
 
 void ImageCanvas::setBrightness(int value)
 {
-    m_brightness = value;
-    m_adjustedImage = applyCurrentAdjustments(m_baseImage);
-    m_displayImage = m_adjustedImage.copy();
-    update();
+    m_adjustments.brightness = value;
+    requestRender();
 }
 
 void ImageCanvas::setContrast(int value)
 {
-    m_contrast = value;
-    m_adjustedImage = applyCurrentAdjustments(m_baseImage);
-    m_displayImage = m_adjustedImage.copy();
-    update();
+    m_adjustments.contrast = value;
+    requestRender();
 }
 
 void ImageCanvas::setSaturation(int value)
 {
-    m_saturation = value;
-    m_adjustedImage = applyCurrentAdjustments(m_baseImage);
-    m_displayImage = m_adjustedImage.copy();
-    update();
+    m_adjustments.saturation = value;
+    requestRender();
 }
 
 void ImageCanvas::resetAdjustments()
 {
-    m_brightness = 100;
-    m_contrast = 100;
-    m_saturation = 100;
-    m_adjustedImage = m_baseImage.copy();
-    m_displayImage = m_adjustedImage.copy();
-    update();
+    m_adjustments = AdjustmentSettings();
+    requestRender();
 }
 
 void ImageCanvas::applyFilter(const QString &filterName)
 {
-    m_currentFilter = filterName;
-    if (filterName.isEmpty()) {
-        m_displayImage = m_adjustedImage.copy();
-    } else {
-        QImage base = m_adjustedImage;
-        if (filterName == "grayscale") m_displayImage = ImageProcessor::applyGrayscale(base, m_filterIntensity);
-        else if (filterName == "sepia") m_displayImage = ImageProcessor::applySepia(base, m_filterIntensity);
-        else if (filterName == "blur") m_displayImage = ImageProcessor::applyBlur(base, m_filterIntensity / 20);
-        else if (filterName == "sharpen") m_displayImage = ImageProcessor::applySharpen(base, m_filterIntensity);
-        else if (filterName == "emboss") m_displayImage = ImageProcessor::applyEmboss(base, m_filterIntensity);
-        else if (filterName == "invert") m_displayImage = ImageProcessor::applyInvert(base);
-        else if (filterName == "warm") m_displayImage = ImageProcessor::applyWarm(base, m_filterIntensity);
-        else if (filterName == "cool") m_displayImage = ImageProcessor::applyCool(base, m_filterIntensity);
-        else if (filterName == "vintage") m_displayImage = ImageProcessor::applyVintage(base, m_filterIntensity);
-        else m_displayImage = base;
-    }
-    update();
+    m_filter.name = filterName;
+    requestRender();
 }
 
 void ImageCanvas::setFilterIntensity(int value)
 {
-    m_filterIntensity = value;
-    applyFilter(m_currentFilter);
+    m_filter.intensity = value;
+    requestRender();
+}
+
+void ImageCanvas::setFilterRadius(int value)
+{
+    m_filter.radius = value;
+    requestRender();
+}
+
+void ImageCanvas::setFilterThreshold(int value)
+{
+    m_filter.threshold = value;
+    requestRender();
+}
+
+void ImageCanvas::setFilterAngle(int value)
+{
+    m_filter.angle = value;
+    requestRender();
+}
+
+void ImageCanvas::beginInteractivePreview()
+{
+    // While a slider is held, process only as many pixels as the screen
+    // shows; the full-resolution render happens once on release.
+    m_previewScale = qMin(1.0, m_zoomFactor * devicePixelRatioF());
+}
+
+void ImageCanvas::endInteractivePreview()
+{
+    m_previewScale = 1.0;
+    requestRender();
 }
 
 void ImageCanvas::applyCropToCurrentRect()
@@ -155,10 +183,7 @@ void ImageCanvas::crop(const QRect &rect)
     if (rect.isEmpty() || !m_image.rect().contains(rect)) return;
     
     saveState();
-    m_image = m_image.copy(rect);
-    m_baseImage = m_image.copy();
-    m_adjustedImage = m_image.copy();
-    m_displayImage = m_image.copy();
+    editDocument([&]() { m_image = m_image.copy(rect); });
     m_cropRect = QRect();
     m_cropMode = false;
     m_modified = true;
@@ -174,21 +199,25 @@ void ImageCanvas::crop(const QRect &rect)
     m_textItems = kept;
     
     emit imageModified(m_image);
-    update();
+    viewport()->update();
 }
 
 void ImageCanvas::rotate(int angle)
 {
     if (m_image.isNull()) return;
     
-    saveState();
-    QTransform transform;
-    transform.rotate(angle);
-    m_image = m_image.transformed(transform, Qt::SmoothTransformation);
-    m_baseImage = m_image.copy();
-    m_adjustedImage = m_image.copy();
-    m_displayImage = m_adjustedImage.copy();
-    m_modified = true;
+    // Quarter turns are exact, so history only needs the angle (and the
+    // tile mirror, see replay()).
+    if (angle % 90 == 0) {
+        HistoryStep step;
+        step.kind = HistoryStep::Rotate;
+        step.angle = angle;
+        step.state = m_tiles;
+        pushStep(step);
+    } else {
+        saveState();
+    }
+    rotateImage(angle);
     
     QPoint center = m_image.rect().center();
     for (TextItem &t : m_textItems) {
@@ -200,45 +229,68 @@ void ImageCanvas::rotate(int angle)
     }
     
     emit imageModified(m_image);
-    update();
+    viewport()->update();
+}
+
+// The pixel half of rotate() and the flips; undo and redo replay only
+// these and leave text where it is, as a restored snapshot would.
+void ImageCanvas::rotateImage(int angle)
+{
+    QTransform transform;
+    transform.rotate(angle);
+    // A quarter turn only moves pixels; without filtering it is exact and
+    // replaying its inverse gives back the original bytes.
+    const Qt::TransformationMode mode = angle % 90 == 0 ? Qt::FastTransformation : Qt::SmoothTransformation;
+    editDocument([&]() { m_image = m_image.transformed(transform, mode); });
+    m_modified = true;
 }
 
 void ImageCanvas::flipHorizontal()
 {
     if (m_image.isNull()) return;
     
-    saveState();
-    m_image = m_image.mirrored(true, false);
-    m_baseImage = m_image.copy();
-    m_adjustedImage = m_image.copy();
-    m_displayImage = m_adjustedImage.copy();
-    m_modified = true;
+    HistoryStep step;
+    step.kind = HistoryStep::FlipHorizontal;
+    step.state = m_tiles;
+    pushStep(step);
+    flipImageHorizontal();
     
     for (TextItem &t : m_textItems) {
         t.pos.setX(m_image.width() - t.pos.x());
     }
     
     emit imageModified(m_image);
-    update();
+    viewport()->update();
+}
+
+void ImageCanvas::flipImageHorizontal()
+{
+    editDocument([&]() { m_image = m_image.mirrored(true, false); });
+    m_modified = true;
 }
 
 void ImageCanvas::flipVertical()
 {
     if (m_image.isNull()) return;
     
-    saveState();
-    m_image = m_image.mirrored(false, true);
-    m_baseImage = m_image.copy();
-    m_adjustedImage = m_image.copy();
-    m_displayImage = m_adjustedImage.copy();
-    m_modified = true;
+    HistoryStep step;
+    step.kind = HistoryStep::FlipVertical;
+    step.state = m_tiles;
+    pushStep(step);
+    flipImageVertical();
     
     for (TextItem &t : m_textItems) {
         t.pos.setY(m_image.height() - t.pos.y());
     }
     
     emit imageModified(m_image);
-    update();
+    viewport()->update();
+}
+
+void ImageCanvas::flipImageVertical()
+{
+    editDocument([&]() { m_image = m_image.mirrored(false, true); });
+    m_modified = true;
 }
 
 void ImageCanvas::resize(int width, int height)
@@ -247,10 +299,7 @@ void ImageCanvas::resize(int width, int height)
     
     QSize oldSize = m_image.size();
     saveState();
-    m_image = m_image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-    m_baseImage = m_image.copy();
-    m_adjustedImage = m_image.copy();
-    m_displayImage = m_adjustedImage.copy();
+    editDocument([&]() { m_image = m_image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation); });
     m_modified = true;
     
     double sx = static_cast<double>(width) / oldSize.width();
@@ -261,33 +310,35 @@ void ImageCanvas::resize(int width, int height)
     }
     
     emit imageModified(m_image);
-    update();
+    viewport()->update();
 }
 
 void ImageCanvas::undo()
 {
     if (!canUndo()) return;
-    m_redoStack.push(m_image);
-    m_image = m_undoStack.pop();
-    m_baseImage = m_image.copy();
-    m_adjustedImage = applyCurrentAdjustments(m_baseImage);
-    m_displayImage = m_adjustedImage.copy();
+    HistoryStep opposite;
+    if (!replay(m_undoStack.pop(), true, &opposite)) {
+        emit statusMessage("撤销失败：无法读取历史记录，该步已丢弃");
+        return;
+    }
+    m_redoStack.push(opposite);
     m_modified = true;
     emit imageModified(m_image);
-    update();
+    viewport()->update();
 }
 
 void ImageCanvas::redo()
 {
     if (!canRedo()) return;
-    m_undoStack.push(m_image);
-    m_image = m_redoStack.pop();
-    m_baseImage = m_image.copy();
-    m_adjustedImage = applyCurrentAdjustments(m_baseImage);
-    m_displayImage = m_adjustedImage.copy();
+    HistoryStep opposite;
+    if (!replay(m_redoStack.pop(), false, &opposite)) {
+        emit statusMessage("重做失败：无法读取历史记录，该步已丢弃");
+        return;
+    }
+    m_undoStack.push(opposite);
     m_modified = true;
     emit imageModified(m_image);
-    update();
+    viewport()->update();
 }
 
 bool ImageCanvas::canUndo() const { return !m_undoStack.isEmpty(); }
@@ -329,26 +380,27 @@ void ImageCanvas::addText(const QString &text, const QPoint &pos)
     item.boundingRect.moveTopLeft(pos);
     m_textItems.append(item);
     m_modified = true;
-    update();
+    updateImageRect(item.boundingRect);
 }
 
 void ImageCanvas::clearTextItems()
 {
     m_textItems.clear();
     m_selectedTextIndex = -1;
-    update();
+    viewport()->update();
 }
 
-void ImageCanvas::setZoomFactor(double factor)
+void ImageCanvas::setZoomFactor(double factor, const QPointF &anchor)
 {
+    const QPointF at = anchor.x() < 0 ? QPointF(viewport()->width() / 2.0, viewport()->height() / 2.0) : anchor;
+    const QPointF imagePoint = (at - imageOrigin()) / m_zoomFactor;
     m_zoomFactor = qBound(0.1, factor, 10.0);
     if (!m_image.isNull()) {
-        setFixedSize(QSize(
-            qMax(width(), static_cast<int>(m_image.width() * m_zoomFactor)),
-            qMax(height(), static_cast<int>(m_image.height() * m_zoomFactor))
-        ));
+        updateScrollBars();
+        horizontalScrollBar()->setValue(qRound(imagePoint.x() * m_zoomFactor - at.x()));
+        verticalScrollBar()->setValue(qRound(imagePoint.y() * m_zoomFactor - at.y()));
     }
-    update();
+    viewport()->update();
     emit statusMessage(QString("缩放: %1%").arg(static_cast<int>(m_zoomFactor * 100)));
 }
 
@@ -358,107 +410,352 @@ void ImageCanvas::zoomOut() { setZoomFactor(m_zoomFactor / 1.25); }
 void ImageCanvas::zoomFit()
 {
     if (m_image.isNull()) return;
-    QWidget *p = parentWidget();
-    if (!p) return;
-    QSize avail = p->size();
+    QSize avail = viewport()->size();
     double sx = static_cast<double>(avail.width()) / m_image.width();
     double sy = static_cast<double>(avail.height()) / m_image.height();
     m_zoomFactor = qBound(0.1, qMin(sx, sy), 10.0);
-    setFixedSize(QSize(
-        static_cast<int>(m_image.width() * m_zoomFactor),
-        static_cast<int>(m_image.height() * m_zoomFactor)
-    ));
-    update();
+    updateScrollBars();
+    horizontalScrollBar()->setValue(0);
+    verticalScrollBar()->setValue(0);
+    viewport()->update();
 }
 
 QImage ImageCanvas::imageForExport() const
 {
     if (m_image.isNull()) return QImage();
-    QImage result = m_displayImage.copy();
-    QPainter p(&result);
-    for (const TextItem &t : m_textItems) {
-        p.setFont(t.font);
-        p.setPen(t.color);
-        p.drawText(t.boundingRect, Qt::AlignLeft | Qt::AlignTop, t.text);
-    }
-    p.end();
-    return result;
+    QMutexLocker locker(&m_renderMutex);
+    m_graph.setAdjustments(m_adjustments);
+    m_graph.setFilter(m_filter);
+    m_graph.setPreviewScale(1.0);
+    m_graph.setTextItems(m_textItems);
+    return m_graph.composite();
 }
 
 void ImageCanvas::zoomOriginal()
 {
-    m_zoomFactor = 1.0;
-    if (!m_image.isNull()) {
-        setFixedSize(m_image.size());
-    }
-    update();
+    setZoomFactor(1.0);
+}
+
+void ImageCanvas::updateScrollBars()
+{
+    const QSize view = viewport()->size();
+    const int contentWidth = m_image.isNull() ? 0 : qCeil(m_image.width() * m_zoomFactor);
+    const int contentHeight = m_image.isNull() ? 0 : qCeil(m_image.height() * m_zoomFactor);
+    horizontalScrollBar()->setRange(0, qMax(0, contentWidth - view.width()));
+    horizontalScrollBar()->setPageStep(view.width());
+    horizontalScrollBar()->setSingleStep(20);
+    verticalScrollBar()->setRange(0, qMax(0, contentHeight - view.height()));
+    verticalScrollBar()->setPageStep(view.height());
+    verticalScrollBar()->setSingleStep(20);
+}
+
+QPointF ImageCanvas::imageOrigin() const
+{
+    // Where image pixel (0, 0) lands in the viewport: centred while the
+    // image fits, otherwise offset by the scroll position.
+    const QSize view = viewport()->size();
+    const double contentWidth = m_image.width() * m_zoomFactor;
+    const double contentHeight = m_image.height() * m_zoomFactor;
+    const double x = contentWidth < view.width() ? qFloor((view.width() - contentWidth) / 2) : -horizontalScrollBar()->value();
+    const double y = contentHeight < view.height() ? qFloor((view.height() - contentHeight) / 2) : -verticalScrollBar()->value();
+    return QPointF(x, y);
 }
 
 QPoint ImageCanvas::mapToImage(const QPoint &pos) const
 {
     if (m_image.isNull()) return QPoint();
-    int x = static_cast<int>(pos.x() / m_zoomFactor);
-    int y = static_cast<int>(pos.y() / m_zoomFactor);
-    return QPoint(x, y);
+    const QPointF origin = imageOrigin();
+    return QPoint(qFloor((pos.x() - origin.x()) / m_zoomFactor), qFloor((pos.y() - origin.y()) / m_zoomFactor));
 }
 
 QRect ImageCanvas::mapFromImage(const QRect &rect) const
 {
-    return QRect(
-        static_cast<int>(rect.x() * m_zoomFactor),
-        static_cast<int>(rect.y() * m_zoomFactor),
-        static_cast<int>(rect.width() * m_zoomFactor),
-        static_cast<int>(rect.height() * m_zoomFactor)
-    );
+    // Round outward so partially covered viewport pixels are included.
+    const QPointF origin = imageOrigin();
+    const int x0 = qFloor(origin.x() + rect.left() * m_zoomFactor);
+    const int y0 = qFloor(origin.y() + rect.top() * m_zoomFactor);
+    const int x1 = qCeil(origin.x() + (rect.right() + 1) * m_zoomFactor);
+    const int y1 = qCeil(origin.y() + (rect.bottom() + 1) * m_zoomFactor);
+    return QRect(QPoint(x0, y0), QPoint(x1 - 1, y1 - 1));
 }
 
 QRect ImageCanvas::mapToImage(const QRect &rect) const
 {
-    return QRect(
-        static_cast<int>(rect.x() / m_zoomFactor),
-        static_cast<int>(rect.y() / m_zoomFactor),
-        static_cast<int>(rect.width() / m_zoomFactor),
-        static_cast<int>(rect.height() / m_zoomFactor)
-    );
+    // Every image pixel that the viewport rect touches.
+    const QPointF origin = imageOrigin();
+    const int x0 = qFloor((rect.left() - origin.x()) / m_zoomFactor);
+    const int y0 = qFloor((rect.top() - origin.y()) / m_zoomFactor);
+    const int x1 = qCeil((rect.right() + 1 - origin.x()) / m_zoomFactor);
+    const int y1 = qCeil((rect.bottom() + 1 - origin.y()) / m_zoomFactor);
+    return QRect(QPoint(x0, y0), QPoint(x1 - 1, y1 - 1));
+}
+
+void ImageCanvas::flushStroke()
+{
+    if (m_pendingStroke.isEmpty() || m_image.isNull()) return;
+    
+    // The whole batch goes through one pipeline update and one repaint.
+    const QRect dirty = m_brushEngine.strokeBounds(m_pendingStroke) & m_image.rect();
+    if (dirty.isEmpty()) {
+        // Dragged off the canvas: nothing changes, but the engine still has
+        // to advance so dab spacing carries over when the stroke returns.
+        // A null rect would tell editDocument the whole image changed.
+        m_brushEngine.strokeTo(m_image, m_pendingStroke);
+    } else {
+        editDocument([&]() { m_brushEngine.strokeTo(m_image, m_pendingStroke); }, dirty);
+        updateImageRect(dirty);
+    }
+    m_pendingStroke.clear();
 }
 
 void ImageCanvas::saveState()
 {
-    pushState(m_image);
+    // Only tiles edited since the last state are copied; the rest stay
+    // shared with it.
+    m_tiles.sync(m_image);
+    HistoryStep step;
+    step.state = m_tiles;
+    pushStep(step);
 }
 
-void ImageCanvas::pushState(const QImage &img)
+void ImageCanvas::pushStep(const HistoryStep &step)
 {
     m_redoStack.clear();
-    m_undoStack.push(img.copy());
+    m_undoStack.push(step);
     while (m_undoStack.size() > MAX_UNDO_STEPS) m_undoStack.removeFirst();
+    // Without a working spill file the threshold is a hard cap on memory.
+    while (m_undoStack.size() > 1 && UndoStore::overLimit()) m_undoStack.removeFirst();
+}
+
+bool ImageCanvas::replay(const HistoryStep &step, bool undo, HistoryStep *opposite)
+{
+    if (step.kind != HistoryStep::Snapshot) {
+        // A transform step carries the tile mirror from the side it returns
+        // to. The transform reproduces those pixels exactly, so the mirror
+        // is adopted as is (tiles it still had stale stay stale) instead of
+        // re-tiling the whole image at the next snapshot.
+        *opposite = step;
+        opposite->state = m_tiles;
+        if (step.kind == HistoryStep::Rotate) rotateImage(undo ? -step.angle : step.angle);
+        else if (step.kind == HistoryStep::FlipHorizontal) flipImageHorizontal();
+        else flipImageVertical();
+        m_tiles = step.state;
+        return true;
+    }
+    
+    // The opposite stack gets the state being left.
+    m_tiles.sync(m_image);
+    *opposite = HistoryStep();
+    opposite->state = m_tiles;
+    return restoreState(step.state);
+}
+
+bool ImageCanvas::restoreState(const TiledImage &state)
+{
+    // Copy back just the tiles that differ, and re-render only that area.
+    // A state whose tiles can't be read back leaves the document as is.
+    const bool sameSize = state.size() == m_image.size();
+    const QRect changed = sameSize ? state.changedFrom(m_tiles) : QRect();
+    bool restored = true;
+    if (!sameSize || !changed.isEmpty()) {
+        editDocument([&]() { restored = state.restoreInto(m_image, m_tiles); }, changed);
+    }
+    if (restored) m_tiles = state;
+    return restored;
+}
+
+void ImageCanvas::editDocument(const std::function<void()> &edit, const QRect &dirty)
+{
+    cancelRender();
+    const QSize oldSize = m_image.size();
+    {
+        // The worker only reads m_image with this lock held, and releasing
+        // the graph's caches here lets the edit write without a detach copy.
+        QMutexLocker locker(&m_renderMutex);
+        if (dirty.isNull()) m_graph.invalidateSource();
+        else m_graph.invalidateRegion(dirty);
+        edit();
+        m_tiles.markStale(m_image.size() == oldSize ? dirty : QRect());
+        // Don't stretch a stale frame over a different geometry; paint the
+        // raw document until the new frame arrives.
+        if (m_image.size() != oldSize) {
+            m_frame = QImage();
+            m_frameIsDocument = false;
+            m_framePyramid.clear();
+            m_geometryGeneration = m_renderGeneration.loadRelaxed();
+        }
+    }
+    if (m_image.size() != oldSize) updateScrollBars();
+    requestRender();
 }
 
-QImage ImageCanvas::applyCurrentAdjustments(const QImage &source) const
+void ImageCanvas::cancelRender()
 {
-    QImage result = source;
-    result = ImageProcessor::adjustBrightness(result, m_brightness);
-    result = ImageProcessor::adjustContrast(result, m_contrast);
-    result = ImageProcessor::adjustSaturation(result, m_saturation);
-    return result;
+    m_renderGeneration.fetchAndAddRelaxed(1);
+}
+
+void ImageCanvas::requestRender()
+{
+    if (m_image.isNull()) {
+        m_frame = QImage();
+        m_frameIsDocument = false;
+        m_framePyramid.clear();
+        viewport()->update();
+        return;
+    }
+    
+    const int generation = m_renderGeneration.fetchAndAddRelaxed(1) + 1;
+    if (!m_rendering) {
+        m_rendering = true;
+        emit renderStarted();
+    }
+    
+    const AdjustmentSettings adjustments = m_adjustments;
+    const FilterSettings filter = m_filter;
+    const double scale = m_previewScale;
+    m_renderPool.start([this, generation, adjustments, filter, scale]() {
+        // A newer request bumps the generation; stale work stops at the
+        // next band and its partial output is never cached or shown.
+        auto cancelled = [this, generation]() { return m_renderGeneration.loadRelaxed() != generation; };
+        if (cancelled()) return;
+        
+        QImage frame;
+        QImage shown;
+        QRect region;
+        bool patch = false;
+        bool document = false;
+        quint64 revision = 0;
+        {
+            QMutexLocker locker(&m_renderMutex);
+            if (cancelled()) return;
+            TileScheduler::CancelScope scope(cancelled);
+            m_graph.setAdjustments(adjustments);
+            m_graph.setFilter(filter);
+            m_graph.setPreviewScale(scale);
+            
+            // After a local edit only the dirty region of the display image
+            // changes; ship just that, provided the canvas already holds
+            // everything the graph rendered before.
+            patch = m_graph.pendingDisplayRegion(&region) && m_graph.displayRevision() == m_deliveredRevision;
+            const QImage &display = m_graph.display();
+            QRect remaining;
+            if (!m_graph.pendingDisplayRegion(&remaining) || !remaining.isEmpty()) return;
+            
+            // With nothing to change the display image is the document, which
+            // the canvas paints directly instead of keeping a copy.
+            document = m_graph.displayIsDocument();
+            // Copied after the lock is released, so an edit waiting on it
+            // doesn't sit through the copy. Holding a reference keeps the
+            // pixels stable: the graph never writes a cache it doesn't own
+            // alone.
+            if (!document) shown = display;
+            revision = m_graph.displayRevision();
+        }
+        
+        if (cancelled()) return;
+        TileScheduler::CancelScope scope(cancelled);
+        if (!document && !patch) {
+            // Into a recycled buffer: the canvas hands its previous frame
+            // back to the pool when it swaps this one in, so steady
+            // re-rendering allocates nothing.
+            frame = ScratchPool::acquire(shown.size(), shown.format());
+            uchar *frameBits = frame.bits();
+            const qsizetype stride = frame.bytesPerLine();
+            const qsizetype rowBytes = qsizetype(shown.width()) * 4;
+            TileScheduler::run(shown.height(), [&](int y0, int y1) {
+                for (int y = y0; y < y1; ++y) memcpy(frameBits + y * stride, shown.constScanLine(y), rowBytes);
+            });
+            if (TileScheduler::isCancelled()) {
+                ScratchPool::release(frame);
+                return;
+            }
+        } else if (!document && !region.isEmpty()) {
+            frame = shown.copy(region);
+        }
+        // Let go before the next render, so the graph can patch in place.
+        shown = QImage();
+        // Only this worker reads or writes the delivered revision.
+        m_deliveredRevision = revision;
+        
+        QMetaObject::invokeMethod(this, [this, generation, frame = std::move(frame), region, patch, document]() mutable {
+            if (!patch) {
+                if (generation > m_geometryGeneration) {
+                    // At the same geometry the pyramid keeps its level
+                    // buffers and only refreshes them.
+                    const QSize oldBase = m_frameIsDocument ? m_image.size() : m_frame.size();
+                    const QSize newBase = document ? m_image.size() : frame.size();
+                    m_frame.swap(frame);
+                    m_frameIsDocument = document;
+                    if (!newBase.isEmpty() && newBase == oldBase) m_framePyramid.markDirty(QRect(QPoint(0, 0), newBase));
+                    else m_framePyramid.clear();
+                }
+                // The frame swapped out, or the new one if it came too late.
+                ScratchPool::release(frame);
+            } else if (document) {
+                if (m_frameIsDocument) m_framePyramid.markDirty(region);
+            } else if (!frame.isNull() && m_frame.rect().contains(region)) {
+                QPainter p(&m_frame);
+                p.setCompositionMode(QPainter::CompositionMode_Source);
+                p.drawImage(region.topLeft(), frame);
+                m_framePyramid.markDirty(region);
+            }
+            if (generation == m_renderGeneration.loadRelaxed()) {
+                m_rendering = false;
+                emit renderFinished();
+            }
+            if (patch) updateImageRect(region);
+            else viewport()->update();
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ImageCanvas::updateImageRect(const QRect &rect)
+{
+    if (rect.isEmpty()) return;
+    // The margin covers the crop and selection outlines drawn around rects.
+    const QRect area = mapFromImage(rect).adjusted(-3, -3, 3, 3) & viewport()->rect();
+    if (!area.isEmpty()) viewport()->update(area);
 }
 
 void ImageCanvas::paintEvent(QPaintEvent *event)
 {
-    Q_UNUSED(event);
-    QPainter p(this);
-    p.fillRect(rect(), QColor(60, 60, 60));
+    const QRect exposed = event->rect();
+    QPainter p(viewport());
+    p.fillRect(exposed, QColor(60, 60, 60));
     
     if (m_image.isNull()) {
         p.setPen(Qt::white);
-        p.drawText(rect(), Qt::AlignCenter, "打开或新建图像以开始编辑");
+        p.drawText(viewport()->rect(), Qt::AlignCenter, "打开或新建图像以开始编辑");
         return;
     }
     
-    QRect imgRect(0, 0, static_cast<int>(m_image.width() * m_zoomFactor),
-                  static_cast<int>(m_image.height() * m_zoomFactor));
-    
-    p.drawImage(imgRect, m_displayImage);
+    // Draw only the source pixels under the exposed part of the viewport;
+    // at high zoom that is a small sub-rect instead of the whole frame.
+    const QRect visible = exposed & mapFromImage(m_image.rect());
+    if (!visible.isEmpty()) {
+        const QRect source = mapToImage(visible) & m_image.rect();
+        const QPointF origin = imageOrigin();
+        
+        // Zoomed out, sample the pyramid level closest above the screen
+        // resolution rather than shrinking the full frame on every paint.
+        const QImage *frame = &m_image;
+        double fx = 1.0;
+        double fy = 1.0;
+        if (!m_frame.isNull() || m_frameIsDocument) {
+            const QImage &base = m_frameIsDocument ? m_image : m_frame;
+            fx = static_cast<double>(base.width()) / m_image.width();
+            fy = static_cast<double>(base.height()) / m_image.height();
+            double levelScale = 1.0;
+            frame = &m_framePyramid.level(base, m_zoomFactor * devicePixelRatioF() / fx, &levelScale);
+            fx *= levelScale;
+            fy *= levelScale;
+        }
+        // Filter only when shrinking; magnified pixels stay sharp squares.
+        p.setRenderHint(QPainter::SmoothPixmapTransform, m_zoomFactor * devicePixelRatioF() < fx);
+        const double z = m_zoomFactor;
+        p.drawImage(QRectF(origin.x() + source.x() * z, origin.y() + source.y() * z, source.width() * z, source.height() * z), *frame,
+                    QRectF(source.x() * fx, source.y() * fy, source.width() * fx, source.height() * fy));
+    }
     
     if (m_cropMode && !m_cropRect.isEmpty()) {
         p.setPen(QPen(Qt::white, 2));
@@ -471,6 +768,7 @@ void ImageCanvas::paintEvent(QPaintEvent *event)
         p.setFont(t.font);
         p.setPen(t.color);
         QRect dr = mapFromImage(t.boundingRect);
+        if (!dr.adjusted(-3, -3, 3, 3).intersects(exposed)) continue;
         p.drawText(dr, Qt::AlignLeft | Qt::AlignTop, t.text);
         if (i == m_selectedTextIndex) {
             p.setPen(QPen(Qt::blue, 2));
@@ -486,17 +784,24 @@ void ImageCanvas::mousePressEvent(QMouseEvent *event)
     if (!m_image.rect().contains(ip)) return;
     
     if (m_tool == ToolType::Crop) {
+        updateImageRect(m_cropRect);
         m_cropRect.setTopLeft(ip);
         m_cropRect.setSize(QSize(0, 0));
         m_drawing = true;
-    } else if (m_tool == ToolType::Brush) {
+    } else if (m_tool == ToolType::Brush || m_tool == ToolType::Eraser) {
         saveState();
-        m_lastPoint = ip;
-        m_drawing = true;
-    } else if (m_tool == ToolType::Eraser) {
-        saveState();
-        m_lastPoint = ip;
+        BrushSettings brush;
+        brush.eraser = (m_tool == ToolType::Eraser);
+        brush.size = brush.eraser ? m_eraserSize : m_brushSize;
+        brush.color = m_brushColor;
+        brush.hardness = m_brushHardness;
+        brush.spacing = m_brushSpacing;
+        brush.flow = m_brushFlow;
+        m_brushEngine.beginStroke(brush);
+        m_pendingStroke.append(ip);
+        flushStroke();
         m_drawing = true;
+        m_modified = true;
     } else if (m_tool == ToolType::Text) {
         bool ok;
         QString text = QInputDialog::getText(this, "添加文字", "请输入文字:", QLineEdit::Normal, "", &ok);
@@ -515,7 +820,7 @@ void ImageCanvas::mousePressEvent(QMouseEvent *event)
             item.boundingRect.moveTopLeft(ip);
             m_textItems.append(item);
             m_modified = true;
-            update();
+            updateImageRect(item.boundingRect);
         }
     } else if (m_tool == ToolType::Pipette) {
         QColor c = m_image.pixelColor(ip);
@@ -528,32 +833,19 @@ void ImageCanvas::mouseMoveEvent(QMouseEvent *event)
     QPoint ip = mapToImage(event->pos());
     
     if (m_drawing && m_tool == ToolType::Crop) {
+        const QRect old = m_cropRect;
         m_cropRect.setBottomRight(ip);
         m_cropRect = m_cropRect.normalized();
-        update();
-    } else if (m_drawing && m_tool == ToolType::Brush) {
-        QPainter painter(&m_image);
-        painter.setPen(QPen(m_brushColor, m_brushSize, Qt::SolidLine, Qt::RoundCap));
-        painter.drawLine(m_lastPoint, ip);
-        painter.end();
-        m_baseImage = m_image.copy();
-        m_adjustedImage = applyCurrentAdjustments(m_baseImage);
-        applyFilter(m_currentFilter);
-        m_lastPoint = ip;
-        m_modified = true;
-        update();
-    } else if (m_drawing && m_tool == ToolType::Eraser) {
-        QPainter painter(&m_image);
-        painter.setCompositionMode(QPainter::CompositionMode_Clear);
-        painter.setPen(QPen(Qt::transparent, m_eraserSize, Qt::SolidLine, Qt::RoundCap));
-        painter.drawLine(m_lastPoint, ip);
-        painter.end();
-        m_baseImage = m_image.copy();
-        m_adjustedImage = applyCurrentAdjustments(m_baseImage);
-        applyFilter(m_currentFilter);
-        m_lastPoint = ip;
+        updateImageRect(old | m_cropRect);
+    } else if (m_drawing && (m_tool == ToolType::Brush || m_tool == ToolType::Eraser)) {
+        // Samples only queue up here; flushStroke() draws them once per
+        // display frame, however fast the mouse reports.
+        m_pendingStroke.append(ip);
+        if (!m_strokeTimer.isActive()) {
+            const double hz = screen() ? screen()->refreshRate() : 60.0;
+            m_strokeTimer.start(qMax(1, qRound(1000.0 / (hz > 0 ? hz : 60.0))));
+        }
         m_modified = true;
-        update();
     }
     
     if (m_image.rect().contains(ip)) {
@@ -566,9 +858,12 @@ void ImageCanvas::mouseReleaseEvent(QMouseEvent *event)
     Q_UNUSED(event);
     if (m_drawing && m_tool == ToolType::Crop) {
         m_drawing = false;
+        const QRect old = m_cropRect;
         m_cropRect = m_cropRect.intersected(m_image.rect());
-        update();
+        updateImageRect(old);
     } else {
+        flushStroke();
+        m_strokeTimer.stop();
         m_drawing = false;
     }
 }
@@ -578,18 +873,34 @@ void ImageCanvas::wheelEvent(QWheelEvent *event)
     if (m_image.isNull()) return;
     
     if (event->modifiers() & Qt::ControlModifier) {
-        if (event->angleDelta().y() > 0) zoomIn();
-        else zoomOut();
+        const double step = event->angleDelta().y() > 0 ? 1.25 : 1 / 1.25;
+        setZoomFactor(m_zoomFactor * step, event->position());
         event->accept();
+    } else {
+        QAbstractScrollArea::wheelEvent(event);
     }
 }
 
 void ImageCanvas::keyPressEvent(QKeyEvent *event)
 {
     if (event->key() == Qt::Key_Delete && m_selectedTextIndex >= 0 && m_selectedTextIndex < m_textItems.size()) {
+        updateImageRect(m_textItems[m_selectedTextIndex].boundingRect);
         m_textItems.removeAt(m_selectedTextIndex);
         m_selectedTextIndex = -1;
         m_modified = true;
-        update();
+    } else {
+        QAbstractScrollArea::keyPressEvent(event);
     }
 }
+
+void ImageCanvas::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void ImageCanvas::scrollContentsBy(int dx, int dy)
+{
+    // Qt blits what is still visible; only the uncovered strips repaint.
+    viewport()->scroll(dx, dy);
+}
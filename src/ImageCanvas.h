@@ -1,13 +1,23 @@
 #ifndef IMAGECANVAS_H
 #define IMAGECANVAS_H
 
-#include <QWidget>
+#include <QAbstractScrollArea>
 #include <QImage>
 #include <QPainter>
 #include <QPoint>
 #include <QPen>
 #include <QStack>
 #include <QString>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QVector>
+#include <functional>
+#include "RenderGraph.h"
+#include "BrushEngine.h"
+#include "MipPyramid.h"
+#include "TiledImage.h"
 
 enum class ToolType {
     Select,
@@ -18,20 +28,16 @@ enum class ToolType {
     Pipette
 };
 
-struct TextItem {
-    QString text;
-    QPoint pos;
-    QFont font;
-    QColor color;
-    QRect boundingRect;
-};
-
-class ImageCanvas : public QWidget
+// The canvas is a fixed-size viewport onto the image rather than a widget
+// grown to image * zoom: it keeps its own scroll offsets and only ever
+// paints the source pixels that are visible.
+class ImageCanvas : public QAbstractScrollArea
 {
     Q_OBJECT
 
 public:
     explicit ImageCanvas(QWidget *parent = nullptr);
+    ~ImageCanvas() override;
     
     bool loadImage(const QString &fileName);
     bool loadImage(const QImage &image);
@@ -45,6 +51,9 @@ public:
     void setBrushSize(int size);
     void setBrushColor(const QColor &color);
     void setEraserSize(int size);
+    void setBrushHardness(int hardness);
+    void setBrushSpacing(int spacing);
+    void setBrushFlow(int flow);
     
     void setBrightness(int value);
     void setContrast(int value);
@@ -53,6 +62,12 @@ public:
     
     void applyFilter(const QString &filterName);
     void setFilterIntensity(int value);
+    void setFilterRadius(int value);
+    void setFilterThreshold(int value);
+    void setFilterAngle(int value);
+    
+    void beginInteractivePreview();
+    void endInteractivePreview();
     
     void crop(const QRect &rect);
     void applyCropToCurrentRect();
@@ -74,7 +89,9 @@ public:
     void clearTextItems();
     
     double zoomFactor() const { return m_zoomFactor; }
-    void setZoomFactor(double factor);
+    // Zooms about `anchor` (viewport coordinates), keeping the image point
+    // under it in place; defaults to the viewport centre.
+    void setZoomFactor(double factor, const QPointF &anchor = QPointF(-1, -1));
     void zoomIn();
     void zoomOut();
     void zoomFit();
@@ -90,6 +107,8 @@ signals:
     void imageModified(const QImage &image);
     void pixelColorPicked(const QColor &color);
     void statusMessage(const QString &message);
+    void renderStarted();
+    void renderFinished();
 
 protected:
     void paintEvent(QPaintEvent *event) override;
@@ -98,22 +117,44 @@ protected:
     void mouseReleaseEvent(QMouseEvent *event) override;
     void wheelEvent(QWheelEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
 
 private:
+    QPointF imageOrigin() const;
     QPoint mapToImage(const QPoint &pos) const;
     QRect mapFromImage(const QRect &rect) const;
     QRect mapToImage(const QRect &rect) const;
+    void updateScrollBars();
+    void updateImageRect(const QRect &rect);
+    // One undo step. Lossless transforms are replayed from their
+    // parameters; anything else restores a saved state.
+    struct HistoryStep {
+        enum Kind { Snapshot, Rotate, FlipHorizontal, FlipVertical };
+        Kind kind = Snapshot;
+        int angle = 0;
+        // Snapshot: the state to restore. Transforms: the tile mirror as it
+        // stood on the side the step leads back to; it shares its tiles.
+        TiledImage state;
+    };
+    
     void saveState();
-    void pushState(const QImage &img);
-    QImage applyCurrentAdjustments(const QImage &source) const;
+    void pushStep(const HistoryStep &step);
+    bool replay(const HistoryStep &step, bool undo, HistoryStep *opposite);
+    bool restoreState(const TiledImage &state);
+    void rotateImage(int angle);
+    void flipImageHorizontal();
+    void flipImageVertical();
+    void flushStroke();
+    void editDocument(const std::function<void()> &edit, const QRect &dirty = QRect());
+    void requestRender();
+    void cancelRender();
     
     QImage m_image;
-    QImage m_displayImage;
-    QImage m_baseImage;
-    QImage m_adjustedImage;
     ToolType m_tool;
     
-    QPoint m_lastPoint;
+    QVector<QPoint> m_pendingStroke;
+    QTimer m_strokeTimer;
     bool m_drawing;
     QRect m_cropRect;
     bool m_cropMode;
@@ -121,24 +162,43 @@ private:
     int m_brushSize;
     QColor m_brushColor;
     int m_eraserSize;
-    
-    int m_brightness;
-    int m_contrast;
-    int m_saturation;
-    
-    QString m_currentFilter;
-    int m_filterIntensity;
+    int m_brushHardness;
+    int m_brushSpacing;
+    int m_brushFlow;
+    BrushEngine m_brushEngine;
     
     QList<TextItem> m_textItems;
     int m_selectedTextIndex;
     bool m_textInputMode;
     
-    QStack<QImage> m_undoStack;
-    QStack<QImage> m_redoStack;
+    // Tiled mirror of m_image that history states are taken from; states
+    // share every tile an edit didn't touch.
+    TiledImage m_tiles;
+    QStack<HistoryStep> m_undoStack;
+    QStack<HistoryStep> m_redoStack;
     static const int MAX_UNDO_STEPS = 50;
     
     double m_zoomFactor;
     bool m_modified;
+    
+    AdjustmentSettings m_adjustments;
+    FilterSettings m_filter;
+    double m_previewScale;
+    
+    // Filters and adjustments render on m_renderPool; m_frame is the last
+    // completed result and stays on screen until the next one lands. When
+    // no stage changes pixels it stays empty and m_image is painted instead.
+    QImage m_frame;
+    bool m_frameIsDocument;
+    // Reductions of the painted frame for painting while zoomed out.
+    MipPyramid m_framePyramid;
+    bool m_rendering;
+    int m_geometryGeneration;
+    quint64 m_deliveredRevision;
+    QAtomicInt m_renderGeneration;
+    mutable QMutex m_renderMutex;
+    mutable RenderGraph m_graph;
+    QThreadPool m_renderPool;
 };
 
 #endif // IMAGECANVAS_H
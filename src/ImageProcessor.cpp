@@ -1,260 +1,678 @@
 #include "ImageProcessor.h"
+#include "PixelKernels.h"
+#include "TileScheduler.h"
+#include "Convolution.h"
+#include "ProcessingHelpers.h"
+#include "ScratchPool.h"
 #include <QtMath>
+#include <QVector>
+#include <algorithm>
 
-QImage ImageProcessor::adjustBrightness(const QImage &image, int value)
+using ProcessingHelpers::prepareResult;
+using ProcessingHelpers::toByte;
+
+namespace {
+
+double contrastFactor(int value)
 {
-    if (image.isNull()) return QImage();
-    
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    int pixels = result.width() * result.height();
-    int brightness = value - 100;
-    
-    for (int i = 0; i < pixels; ++i) {
-        QRgb *pixel = reinterpret_cast<QRgb*>(result.bits()) + i;
-        int r = qBound(0, qRed(*pixel) + brightness, 255);
-        int g = qBound(0, qGreen(*pixel) + brightness, 255);
-        int b = qBound(0, qBlue(*pixel) + brightness, 255);
-        *pixel = qRgba(r, g, b, qAlpha(*pixel));
-    }
-    return result;
+    double factor = (value - 100.0) / 100.0;
+    return (factor >= 0) ? (1 + factor) : (1.0 / (1 - factor));
 }
 
-QImage ImageProcessor::adjustContrast(const QImage &image, int value)
+ColorMatrix warmMatrix(int intensity)
 {
-    if (image.isNull()) return QImage();
-    
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    double factor = (value - 100.0) / 100.0;
-    factor = (factor >= 0) ? (1 + factor) : (1.0 / (1 - factor));
-    
-    int pixels = result.width() * result.height();
-    for (int i = 0; i < pixels; ++i) {
-        QRgb *pixel = reinterpret_cast<QRgb*>(result.bits()) + i;
-        int r = qBound(0, static_cast<int>((qRed(*pixel) - 128) * factor + 128), 255);
-        int g = qBound(0, static_cast<int>((qGreen(*pixel) - 128) * factor + 128), 255);
-        int b = qBound(0, static_cast<int>((qBlue(*pixel) - 128) * factor + 128), 255);
-        *pixel = qRgba(r, g, b, qAlpha(*pixel));
-    }
-    return result;
+    double factor = intensity / 100.0;
+    return ColorMatrix::channelOffset(static_cast<int>(30 * factor), 0, static_cast<int>(-20 * factor));
 }
 
-QImage ImageProcessor::adjustSaturation(const QImage &image, int value)
+ColorMatrix coolMatrix(int intensity)
+{
+    double factor = intensity / 100.0;
+    return ColorMatrix::channelOffset(static_cast<int>(-20 * factor), 0, static_cast<int>(30 * factor));
+}
+
+ColorMatrix vintageMatrix(int intensity)
+{
+    return ColorMatrix::sepia(0.7)
+        .then(ColorMatrix::contrast(contrastFactor(90 + intensity / 5)))
+        .then(warmMatrix(intensity));
+}
+
+struct SharpenKernel
 {
-    if (image.isNull()) return QImage();
+    static constexpr int values[3][3] = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
+    constexpr int at(int row, int column) const { return values[row][column]; }
+};
+
+struct EmbossKernel
+{
+    static constexpr int values[3][3] = {{-2, -1, 0}, {-1, 1, 1}, {0, 1, 2}};
+    constexpr int at(int row, int column) const { return values[row][column]; }
+};
+
+template <int Size, typename Kernel, typename Finish>
+void convolve(const QImage &image, QImage &result, const Kernel &kernel, BorderMode border, Finish finish)
+{
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    prepareResult(source.size(), result);
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        Convolution::convolveRows<Size>(source, resultBits, stride, y0, y1, kernel, border, finish);
+        for (int y = y0; y < y1; ++y) {
+            PixelKernels::clampToAlpha(reinterpret_cast<QRgb*>(resultBits + y * stride), source.width());
+        }
+    });
+}
+
+template <int Size>
+void convolveWeights(const QImage &image, QImage &result, const QVector<int> &weights, int divisor, int bias,
+                     BorderMode border)
+{
+    Convolution::Weights<Size> kernel;
+    for (int i = 0; i < Size * Size; ++i) kernel.values[i / Size][i % Size] = weights[i];
+    convolve<Size>(image, result, kernel, border, [divisor, bias](int r, int g, int b, QRgb orig) {
+        // The bias is a colour offset, so it is premultiplied like the pixels.
+        const int a = qAlpha(orig);
+        const int offset = bias * a / 255;
+        auto channel = [divisor, offset](int sum) { return qBound(0, sum / divisor + offset, 255); };
+        return qRgba(channel(r), channel(g), channel(b), a);
+    });
+}
+
+// Running-sum box blur over rows [y0, y1). Column sums of the (2r+1) rows
+// around y are slid down the image, and each output row is a horizontal
+// sliding window over those sums, so the cost per pixel does not depend on
+// the radius. Samples outside the image are clamped to the nearest edge.
+void boxBlurRows(const QImage &source, uchar *resultBits, qsizetype resultStride, int radius, int y0, int y1)
+{
+    const int w = source.width();
+    const int h = source.height();
+    const int channels = w * 4;
+    const int size = radius * 2 + 1;
+    const int area = size * size;
+    const int half = area / 2;
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    double factor = value / 100.0;
+    QVector<int> columnSums(channels, 0);
+    for (int dy = -radius; dy <= radius; ++dy) {
+        const uchar *row = source.constScanLine(qBound(0, y0 + dy, h - 1));
+        for (int i = 0; i < channels; ++i) columnSums[i] += row[i];
+    }
     
-    int pixels = result.width() * result.height();
-    for (int i = 0; i < pixels; ++i) {
-        QRgb *pixel = reinterpret_cast<QRgb*>(result.bits()) + i;
-        int r = qRed(*pixel);
-        int g = qGreen(*pixel);
-        int b = qBlue(*pixel);
+    int *sums = columnSums.data();
+    for (int y = y0; y < y1; ++y) {
+        uchar *out = resultBits + y * resultStride;
+        int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (int dx = -radius; dx <= radius; ++dx) {
+            const int *c = sums + qBound(0, dx, w - 1) * 4;
+            s0 += c[0];
+            s1 += c[1];
+            s2 += c[2];
+            s3 += c[3];
+        }
+        for (int x = 0; x < w; ++x) {
+            out[x * 4 + 0] = static_cast<uchar>((s0 + half) / area);
+            out[x * 4 + 1] = static_cast<uchar>((s1 + half) / area);
+            out[x * 4 + 2] = static_cast<uchar>((s2 + half) / area);
+            out[x * 4 + 3] = static_cast<uchar>((s3 + half) / area);
+            const int *in = sums + qMin(x + radius + 1, w - 1) * 4;
+            const int *outgoing = sums + qMax(x - radius, 0) * 4;
+            s0 += in[0] - outgoing[0];
+            s1 += in[1] - outgoing[1];
+            s2 += in[2] - outgoing[2];
+            s3 += in[3] - outgoing[3];
+        }
         
-        int gray = (r * 299 + g * 587 + b * 114) / 1000;
-        r = qBound(0, static_cast<int>(gray + (r - gray) * factor), 255);
-        g = qBound(0, static_cast<int>(gray + (g - gray) * factor), 255);
-        b = qBound(0, static_cast<int>(gray + (b - gray) * factor), 255);
-        *pixel = qRgba(r, g, b, qAlpha(*pixel));
+        if (y + 1 < y1) {
+            const uchar *add = source.constScanLine(qMin(y + radius + 1, h - 1));
+            const uchar *sub = source.constScanLine(qMax(y - radius, 0));
+            for (int i = 0; i < channels; ++i) sums[i] += add[i] - sub[i];
+        }
     }
-    return result;
 }
 
-QImage ImageProcessor::applyGrayscale(const QImage &image, int intensity)
+
+// Young & van Vliet recursive Gaussian: a third-order causal pass followed by
+// an anti-causal one, so the cost per sample is fixed whatever the sigma.
+// data holds count samples of `lanes` interleaved floats (one pixel's four
+// channels for a row, or a whole strip of pixels for columns) plus room for
+// `padding` more. Edges are a constant extension of the first/last sample:
+// that is exact for the causal pass, and the anti-causal pass starts from
+// the padded tail, once the causal response has settled.
+struct GaussianCoefficients
 {
-    if (image.isNull()) return QImage();
+    float B, b1, b2, b3;
+    int padding;
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    double blend = intensity / 100.0;
+    explicit GaussianCoefficients(double sigma)
+    {
+        padding = qCeil(4 * sigma);
+        double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * qSqrt(1 - 0.26891 * sigma);
+        double q2 = q * q, q3 = q2 * q;
+        double d0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+        double d1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+        double d2 = -(1.4281 * q2 + 1.26661 * q3);
+        double d3 = 0.422205 * q3;
+        b1 = static_cast<float>(d1 / d0);
+        b2 = static_cast<float>(d2 / d0);
+        b3 = static_cast<float>(d3 / d0);
+        B = 1.0f - (b1 + b2 + b3);
+    }
+};
+
+void recursiveGaussian(float *data, int count, int lanes, const GaussianCoefficients &c)
+{
+    const float *last = data + (count - 1) * lanes;
+    for (int n = count; n < count + c.padding; ++n) {
+        std::copy(last, last + lanes, data + n * lanes);
+    }
+    count += c.padding;
     
-    for (int y = 0; y < result.height(); ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(result.scanLine(y));
-        for (int x = 0; x < result.width(); ++x) {
-            int gray = (qRed(line[x]) * 299 + qGreen(line[x]) * 587 + qBlue(line[x]) * 114) / 1000;
-            int r = qBound(0, static_cast<int>(qRed(line[x]) * (1 - blend) + gray * blend), 255);
-            int g = qBound(0, static_cast<int>(qGreen(line[x]) * (1 - blend) + gray * blend), 255);
-            int b = qBound(0, static_cast<int>(qBlue(line[x]) * (1 - blend) + gray * blend), 255);
-            line[x] = qRgba(r, g, b, qAlpha(line[x]));
-        }
+    for (int n = 1; n < count; ++n) {
+        float *cur = data + n * lanes;
+        const float *p1 = data + (n - 1) * lanes;
+        const float *p2 = data + qMax(n - 2, 0) * lanes;
+        const float *p3 = data + qMax(n - 3, 0) * lanes;
+        for (int i = 0; i < lanes; ++i) cur[i] = c.B * cur[i] + c.b1 * p1[i] + c.b2 * p2[i] + c.b3 * p3[i];
+    }
+    for (int n = count - 2; n >= 0; --n) {
+        float *cur = data + n * lanes;
+        const float *p1 = data + (n + 1) * lanes;
+        const float *p2 = data + qMin(n + 2, count - 1) * lanes;
+        const float *p3 = data + qMin(n + 3, count - 1) * lanes;
+        for (int i = 0; i < lanes; ++i) cur[i] = c.B * cur[i] + c.b1 * p1[i] + c.b2 * p2[i] + c.b3 * p3[i];
     }
-    return result;
 }
 
-QImage ImageProcessor::applySepia(const QImage &image, int intensity)
+// Perreault & Hebert constant-time median over rows [y0, y1), run on every
+// byte of the scanline (so each ARGB channel independently). Each column
+// keeps a histogram of its 2r+1 rows; the kernel histogram slides along the
+// row by adding one column and dropping another. Histograms are split into
+// 16 coarse and 256 fine bins: the coarse ones are kept current for every
+// pixel, and a fine segment is only brought up to date when the median
+// lands in it. Edge rows and columns are clamped.
+void medianRows(const QImage &source, uchar *resultBits, qsizetype resultStride, int radius, int y0, int y1)
 {
-    if (image.isNull()) return QImage();
+    const int w = source.width();
+    const int h = source.height();
+    const int lanes = w * 4;
+    const int size = radius * 2 + 1;
+    const int half = size * size / 2;
+    
+    QVector<quint16> columnFine(lanes * 256, 0);
+    QVector<quint16> columnCoarse(lanes * 16, 0);
+    auto updateColumns = [&](int y, int delta) {
+        const uchar *row = source.constScanLine(qBound(0, y, h - 1));
+        for (int i = 0; i < lanes; ++i) {
+            columnFine[i * 256 + row[i]] += delta;
+            columnCoarse[i * 16 + (row[i] >> 4)] += delta;
+        }
+    };
+    for (int dy = -radius; dy <= radius; ++dy) updateColumns(y0 + dy, 1);
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    double blend = intensity / 100.0;
+    quint16 coarse[4][16];
+    quint16 fine[4][256];
+    int fineX[4][16];
+    auto addColumn = [&](quint16 *histogram, const quint16 *column, int count, int sign) {
+        for (int k = 0; k < count; ++k) histogram[k] += sign * column[k];
+    };
     
-    for (int y = 0; y < result.height(); ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(result.scanLine(y));
-        for (int x = 0; x < result.width(); ++x) {
-            int r = qRed(line[x]);
-            int g = qGreen(line[x]);
-            int b = qBlue(line[x]);
-            
-            int tr = qBound(0, static_cast<int>(r * 0.393 + g * 0.769 + b * 0.189), 255);
-            int tg = qBound(0, static_cast<int>(r * 0.349 + g * 0.686 + b * 0.168), 255);
-            int tb = qBound(0, static_cast<int>(r * 0.272 + g * 0.534 + b * 0.131), 255);
+    for (int y = y0; y < y1; ++y) {
+        if (y > y0) {
+            updateColumns(y - radius - 1, -1);
+            updateColumns(y + radius, 1);
+        }
+        
+        std::fill(&coarse[0][0], &coarse[0][0] + 4 * 16, 0);
+        std::fill(&fineX[0][0], &fineX[0][0] + 4 * 16, -size - 1);
+        for (int dx = -radius; dx <= radius; ++dx) {
+            const int column = qBound(0, dx, w - 1);
+            for (int c = 0; c < 4; ++c) addColumn(coarse[c], &columnCoarse[(column * 4 + c) * 16], 16, 1);
+        }
+        
+        uchar *out = resultBits + y * resultStride;
+        for (int x = 0; x < w; ++x) {
+            const int incoming = qMin(x + radius, w - 1);
+            const int outgoing = qMax(x - radius - 1, 0);
+            if (x > 0) {
+                for (int c = 0; c < 4; ++c) {
+                    addColumn(coarse[c], &columnCoarse[(incoming * 4 + c) * 16], 16, 1);
+                    addColumn(coarse[c], &columnCoarse[(outgoing * 4 + c) * 16], 16, -1);
+                }
+            }
             
-            r = static_cast<int>(r * (1 - blend) + tr * blend);
-            g = static_cast<int>(g * (1 - blend) + tg * blend);
-            b = static_cast<int>(b * (1 - blend) + tb * blend);
-            line[x] = qRgba(qBound(0, r, 255), qBound(0, g, 255), qBound(0, b, 255), qAlpha(line[x]));
+            for (int c = 0; c < 4; ++c) {
+                int sum = 0;
+                int bucket = 0;
+                while (sum + coarse[c][bucket] <= half) sum += coarse[c][bucket++];
+                
+                quint16 *segment = fine[c] + bucket * 16;
+                int &updatedAt = fineX[c][bucket];
+                if (x - updatedAt > size) {
+                    std::fill(segment, segment + 16, 0);
+                    for (int dx = -radius; dx <= radius; ++dx) {
+                        const int column = qBound(0, x + dx, w - 1);
+                        addColumn(segment, &columnFine[(column * 4 + c) * 256 + bucket * 16], 16, 1);
+                    }
+                } else {
+                    for (int xx = updatedAt + 1; xx <= x; ++xx) {
+                        const int in = qMin(xx + radius, w - 1);
+                        const int gone = qMax(xx - radius - 1, 0);
+                        addColumn(segment, &columnFine[(in * 4 + c) * 256 + bucket * 16], 16, 1);
+                        addColumn(segment, &columnFine[(gone * 4 + c) * 256 + bucket * 16], 16, -1);
+                    }
+                }
+                updatedAt = x;
+                
+                int value = 0;
+                while (sum + segment[value] <= half) sum += segment[value++];
+                out[x * 4 + c] = static_cast<uchar>(bucket * 16 + value);
+            }
         }
+        // Channels take their medians independently, so a colour can
+        // outgrow its alpha.
+        PixelKernels::clampToAlpha(reinterpret_cast<QRgb*>(out), w);
     }
-    return result;
 }
 
-QImage ImageProcessor::applyBlur(const QImage &image, int radius)
+} // namespace
+
+QImage ImageProcessor::adjustBrightness(const QImage &image, int value)
+{
+    return applyColorMatrix(image, ColorMatrix::brightness(value - 100));
+}
+
+QImage ImageProcessor::adjustContrast(const QImage &image, int value)
+{
+    return applyColorMatrix(image, ColorMatrix::contrast(contrastFactor(value)));
+}
+
+QImage ImageProcessor::adjustSaturation(const QImage &image, int value)
+{
+    return applyColorMatrix(image, ColorMatrix::saturation(value / 100.0));
+}
+
+void ImageProcessor::applyAdjustments(const QImage &image, QImage &result, int brightness, int contrast,
+                                      int saturation, const ColorMatrix &post)
 {
-    if (image.isNull() || radius <= 0) return image;
+    if (image.isNull()) {
+        result = QImage();
+        return;
+    }
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    int size = radius * 2 + 1;
-    int total = size * size;
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    bool toneIdentity = (brightness == 100 && contrast == 100);
+    ColorMatrix matrix = ColorMatrix::saturation(saturation / 100.0).then(post);
+    if (toneIdentity && matrix.isIdentity()) {
+        result = source;
+        return;
+    }
+    
+    prepareResult(source.size(), result);
+    
+    double factor = contrastFactor(contrast);
+    uchar lut[256];
+    for (int v = 0; v < 256; ++v) {
+        int b = qBound(0, v + brightness - 100, 255);
+        lut[v] = static_cast<uchar>(qBound(0, qRound((b - 128) * factor + 128), 255));
+    }
     
-    for (int y = radius; y < result.height() - radius; ++y) {
-        for (int x = radius; x < result.width() - radius; ++x) {
-            int sr = 0, sg = 0, sb = 0, sa = 0;
-            for (int dy = -radius; dy <= radius; ++dy) {
-                for (int dx = -radius; dx <= radius; ++dx) {
-                    QRgb p = result.pixel(x + dx, y + dy);
-                    sr += qRed(p);
-                    sg += qGreen(p);
-                    sb += qBlue(p);
-                    sa += qAlpha(p);
+    const int width = source.width();
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const QRgb *in = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            QRgb *out = reinterpret_cast<QRgb*>(resultBits + y * stride);
+            // Tone curves act on straight colour; opaque rows skip the
+            // round trip.
+            const bool translucent = !PixelKernels::isOpaque(in, width);
+            if (translucent) {
+                PixelKernels::unpremultiply(in, out, width);
+                in = out;
+            }
+            if (toneIdentity) {
+                PixelKernels::applyColorMatrix(in, out, width, matrix);
+            } else {
+                for (int x = 0; x < width; ++x) {
+                    QRgb p = in[x];
+                    out[x] = qRgba(lut[qRed(p)], lut[qGreen(p)], lut[qBlue(p)], qAlpha(p));
                 }
+                if (!matrix.isIdentity()) PixelKernels::applyColorMatrix(out, out, width, matrix);
             }
-            result.setPixel(x, y, qRgba(sr / total, sg / total, sb / total, sa / total));
+            if (translucent) PixelKernels::premultiply(out, out, width);
         }
-    }
+    });
+}
+
+QImage ImageProcessor::applyColorMatrix(const QImage &image, const ColorMatrix &matrix)
+{
+    QImage result;
+    applyColorMatrix(image, result, matrix);
     return result;
 }
 
-QImage ImageProcessor::applySharpen(const QImage &image, int intensity)
+void ImageProcessor::applyColorMatrix(const QImage &image, QImage &result, const ColorMatrix &matrix)
 {
-    if (image.isNull()) return QImage();
-    
-    static int kernel[3][3] = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
-    double factor = intensity / 100.0;
+    if (image.isNull()) {
+        result = QImage();
+        return;
+    }
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    QImage temp = result.copy();
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    if (matrix.isIdentity()) {
+        result = source;
+        return;
+    }
     
-    for (int y = 1; y < result.height() - 1; ++y) {
-        for (int x = 1; x < result.width() - 1; ++x) {
-            int r = 0, g = 0, b = 0;
-            for (int dy = -1; dy <= 1; ++dy) {
-                for (int dx = -1; dx <= 1; ++dx) {
-                    QRgb p = temp.pixel(x + dx, y + dy);
-                    int k = kernel[dy + 1][dx + 1];
-                    r += qRed(p) * k;
-                    g += qGreen(p) * k;
-                    b += qBlue(p) * k;
-                }
+    prepareResult(source.size(), result);
+    const int width = source.width();
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const QRgb *in = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            QRgb *out = reinterpret_cast<QRgb*>(resultBits + y * stride);
+            if (PixelKernels::isOpaque(in, width)) {
+                PixelKernels::applyColorMatrix(in, out, width, matrix);
+            } else {
+                PixelKernels::unpremultiply(in, out, width);
+                PixelKernels::applyColorMatrix(out, out, width, matrix);
+                PixelKernels::premultiply(out, out, width);
             }
-            QRgb orig = temp.pixel(x, y);
-            r = qBound(0, static_cast<int>(qRed(orig) + (r - qRed(orig)) * factor), 255);
-            g = qBound(0, static_cast<int>(qGreen(orig) + (g - qGreen(orig)) * factor), 255);
-            b = qBound(0, static_cast<int>(qBlue(orig) + (b - qBlue(orig)) * factor), 255);
-            result.setPixel(x, y, qRgba(r, g, b, qAlpha(orig)));
         }
+    });
+}
+
+bool ImageProcessor::filterColorMatrix(const QString &filterName, int intensity, ColorMatrix &matrix)
+{
+    double amount = intensity / 100.0;
+    if (filterName == "grayscale") matrix = ColorMatrix::grayscale(amount);
+    else if (filterName == "sepia") matrix = ColorMatrix::sepia(amount);
+    else if (filterName == "invert") matrix = ColorMatrix::invert();
+    else if (filterName == "warm") matrix = warmMatrix(intensity);
+    else if (filterName == "cool") matrix = coolMatrix(intensity);
+    else if (filterName == "vintage") matrix = vintageMatrix(intensity);
+    else return false;
+    return true;
+}
+
+QImage ImageProcessor::applyGrayscale(const QImage &image, int intensity)
+{
+    return applyColorMatrix(image, ColorMatrix::grayscale(intensity / 100.0));
+}
+
+QImage ImageProcessor::applySepia(const QImage &image, int intensity)
+{
+    return applyColorMatrix(image, ColorMatrix::sepia(intensity / 100.0));
+}
+
+QImage ImageProcessor::applyBlur(const QImage &image, int radius)
+{
+    QImage result;
+    applyBlur(image, result, radius);
+    return result;
+}
+
+void ImageProcessor::applyBlur(const QImage &image, QImage &result, int radius)
+{
+    if (image.isNull() || radius <= 0) {
+        result = image;
+        return;
     }
+    
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    prepareResult(source.size(), result);
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        boxBlurRows(source, resultBits, stride, radius, y0, y1);
+    }, qMax(16, radius));
+}
+
+QImage ImageProcessor::applyGaussianBlur(const QImage &image, double sigma)
+{
+    QImage result;
+    applyGaussianBlur(image, result, sigma);
     return result;
 }
 
-QImage ImageProcessor::applyEmboss(const QImage &image, int intensity)
+void ImageProcessor::applyGaussianBlur(const QImage &image, QImage &result, double sigma)
 {
-    if (image.isNull()) return QImage();
+    if (image.isNull() || sigma < 0.5) {
+        result = image;
+        return;
+    }
     
-    static int kernel[3][3] = {{-2, -1, 0}, {-1, 1, 1}, {0, 1, 2}};
-    double factor = intensity / 100.0;
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    prepareResult(source.size(), result);
+    const GaussianCoefficients coefficients(sigma);
+    const int width = source.width();
+    const int height = source.height();
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    QImage temp = result.copy();
+    TileScheduler::run(height, [&](int y0, int y1) {
+        QVector<float> line((width + coefficients.padding) * 4);
+        for (int y = y0; y < y1; ++y) {
+            const uchar *in = source.constScanLine(y);
+            for (int i = 0; i < width * 4; ++i) line[i] = in[i];
+            recursiveGaussian(line.data(), width, 4, coefficients);
+            uchar *out = resultBits + y * stride;
+            for (int i = 0; i < width * 4; ++i) out[i] = toByte(line[i]);
+        }
+    });
     
-    for (int y = 1; y < result.height() - 1; ++y) {
-        for (int x = 1; x < result.width() - 1; ++x) {
-            int gray = 0;
-            for (int dy = -1; dy <= 1; ++dy) {
-                for (int dx = -1; dx <= 1; ++dx) {
-                    QRgb p = temp.pixel(x + dx, y + dy);
-                    int g = (qRed(p) + qGreen(p) + qBlue(p)) / 3;
-                    gray += g * kernel[dy + 1][dx + 1];
-                }
+    // Columns are filtered a strip at a time so each row access stays
+    // contiguous; the strip's lanes advance down the image together.
+    const int stripWidth = 64;
+    const int strips = (width + stripWidth - 1) / stripWidth;
+    TileScheduler::run(strips, [&](int s0, int s1) {
+        QVector<float> block((height + coefficients.padding) * stripWidth * 4);
+        for (int s = s0; s < s1; ++s) {
+            const int x0 = s * stripWidth;
+            const int lanes = qMin(stripWidth, width - x0) * 4;
+            for (int y = 0; y < height; ++y) {
+                const uchar *row = resultBits + y * stride + x0 * 4;
+                float *dst = block.data() + y * lanes;
+                for (int i = 0; i < lanes; ++i) dst[i] = row[i];
+            }
+            recursiveGaussian(block.data(), height, lanes, coefficients);
+            for (int y = 0; y < height; ++y) {
+                uchar *row = resultBits + y * stride + x0 * 4;
+                const float *src = block.data() + y * lanes;
+                for (int i = 0; i < lanes; ++i) row[i] = toByte(src[i]);
+                // The recursive filter overshoots slightly at sharp edges.
+                PixelKernels::clampToAlpha(reinterpret_cast<QRgb*>(row), lanes / 4);
             }
-            gray = 128 + static_cast<int>(gray * factor);
-            gray = qBound(0, gray, 255);
-            QRgb orig = temp.pixel(x, y);
-            int r = qBound(0, static_cast<int>(qRed(orig) * (1 - factor) + gray * factor), 255);
-            int g = qBound(0, static_cast<int>(qGreen(orig) * (1 - factor) + gray * factor), 255);
-            int b = qBound(0, static_cast<int>(qBlue(orig) * (1 - factor) + gray * factor), 255);
-            result.setPixel(x, y, qRgba(r, g, b, qAlpha(orig)));
         }
-    }
+    }, 1);
+}
+
+QImage ImageProcessor::applyUnsharpMask(const QImage &image, double radius, int amount, int threshold)
+{
+    QImage result;
+    applyUnsharpMask(image, result, radius, amount, threshold);
     return result;
 }
 
-QImage ImageProcessor::applyInvert(const QImage &image)
+void ImageProcessor::applyUnsharpMask(const QImage &image, QImage &result, double radius, int amount, int threshold)
 {
-    if (image.isNull()) return QImage();
+    if (image.isNull() || radius < 0.5 || amount <= 0) {
+        result = image;
+        return;
+    }
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    int pixels = result.width() * result.height();
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    QImage blurred = ScratchPool::acquire(source.size(), ImageProcessor::WorkingFormat);
+    applyGaussianBlur(source, blurred, radius);
+    prepareResult(source.size(), result);
     
-    for (int i = 0; i < pixels; ++i) {
-        QRgb *pixel = reinterpret_cast<QRgb*>(result.bits()) + i;
-        int r = 255 - qRed(*pixel);
-        int g = 255 - qGreen(*pixel);
-        int b = 255 - qBlue(*pixel);
-        *pixel = qRgba(r, g, b, qAlpha(*pixel));
+    const int width = source.width();
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const QRgb *in = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            const QRgb *blur = reinterpret_cast<const QRgb*>(blurred.constScanLine(y));
+            QRgb *out = reinterpret_cast<QRgb*>(resultBits + y * stride);
+            for (int x = 0; x < width; ++x) {
+                QRgb p = in[x], b = blur[x];
+                const int alpha = qAlpha(p);
+                auto sharpen = [amount, threshold, alpha](int orig, int smooth) {
+                    int diff = orig - smooth;
+                    if (qAbs(diff) < threshold) return orig;
+                    return qBound(0, orig + (diff * amount + (diff >= 0 ? 50 : -50)) / 100, alpha);
+                };
+                out[x] = qRgba(sharpen(qRed(p), qRed(b)), sharpen(qGreen(p), qGreen(b)),
+                               sharpen(qBlue(p), qBlue(b)), alpha);
+            }
+        }
+    });
+    ScratchPool::release(blurred);
+}
+
+QImage ImageProcessor::applyLensBlur(const QImage &image, int radius)
+{
+    QImage result;
+    applyLensBlur(image, result, radius);
+    return result;
+}
+
+void ImageProcessor::applyLensBlur(const QImage &image, QImage &result, int radius)
+{
+    if (radius <= 0) {
+        result = image;
+        return;
     }
+    KernelConvolution::apply(image, result, ConvolutionKernel::disc(radius));
+}
+
+QImage ImageProcessor::applyMotionBlur(const QImage &image, int length, double angle)
+{
+    QImage result;
+    applyMotionBlur(image, result, length, angle);
     return result;
 }
 
-QImage ImageProcessor::applyWarm(const QImage &image, int intensity)
+void ImageProcessor::applyMotionBlur(const QImage &image, QImage &result, int length, double angle)
 {
-    if (image.isNull()) return QImage();
-    
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    double factor = intensity / 100.0;
-    
-    for (int y = 0; y < result.height(); ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(result.scanLine(y));
-        for (int x = 0; x < result.width(); ++x) {
-            int r = qBound(0, static_cast<int>(qRed(line[x]) + 30 * factor), 255);
-            int b = qBound(0, static_cast<int>(qBlue(line[x]) - 20 * factor), 255);
-            line[x] = qRgba(r, qGreen(line[x]), b, qAlpha(line[x]));
-        }
+    if (length <= 1) {
+        result = image;
+        return;
     }
+    KernelConvolution::apply(image, result, ConvolutionKernel::motion(length, angle));
+}
+
+QImage ImageProcessor::applyMedian(const QImage &image, int radius)
+{
+    QImage result;
+    applyMedian(image, result, radius);
     return result;
 }
 
-QImage ImageProcessor::applyCool(const QImage &image, int intensity)
+void ImageProcessor::applyMedian(const QImage &image, QImage &result, int radius)
 {
-    if (image.isNull()) return QImage();
+    if (image.isNull() || radius <= 0) {
+        result = image;
+        return;
+    }
     
-    QImage result = image.convertToFormat(QImage::Format_ARGB32);
-    double factor = intensity / 100.0;
+    // Column counts are 16-bit, which caps the window at (2 * 127 + 1)^2.
+    radius = qMin(radius, 127);
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    prepareResult(source.size(), result);
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        medianRows(source, resultBits, stride, radius, y0, y1);
+    }, qMax(16, 2 * radius));
+}
+
+QImage ImageProcessor::applySharpen(const QImage &image, int intensity, BorderMode border)
+{
+    QImage result;
+    applySharpen(image, result, intensity, border);
+    return result;
+}
+
+void ImageProcessor::applySharpen(const QImage &image, QImage &result, int intensity, BorderMode border)
+{
+    if (image.isNull()) {
+        result = QImage();
+        return;
+    }
     
-    for (int y = 0; y < result.height(); ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(result.scanLine(y));
-        for (int x = 0; x < result.width(); ++x) {
-            int r = qBound(0, static_cast<int>(qRed(line[x]) - 20 * factor), 255);
-            int b = qBound(0, static_cast<int>(qBlue(line[x]) + 30 * factor), 255);
-            line[x] = qRgba(r, qGreen(line[x]), b, qAlpha(line[x]));
-        }
+    double factor = intensity / 100.0;
+    auto blend = [factor](int orig, int sum) {
+        return qBound(0, static_cast<int>(orig + (sum - orig) * factor), 255);
+    };
+    convolve<3>(image, result, SharpenKernel(), border, [&blend](int r, int g, int b, QRgb orig) {
+        return qRgba(blend(qRed(orig), r), blend(qGreen(orig), g), blend(qBlue(orig), b), qAlpha(orig));
+    });
+}
+
+QImage ImageProcessor::applyEmboss(const QImage &image, int intensity, BorderMode border)
+{
+    QImage result;
+    applyEmboss(image, result, intensity, border);
+    return result;
+}
+
+void ImageProcessor::applyEmboss(const QImage &image, QImage &result, int intensity, BorderMode border)
+{
+    if (image.isNull()) {
+        result = QImage();
+        return;
     }
+    
+    double factor = intensity / 100.0;
+    convolve<3>(image, result, EmbossKernel(), border, [factor](int r, int g, int b, QRgb orig) {
+        // Mid-grey, premultiplied by the pixel's coverage.
+        const int mid = (128 * qAlpha(orig) + 127) / 255;
+        int gray = qBound(0, mid + static_cast<int>((r + g + b) / 3 * factor), 255);
+        auto blend = [factor, gray](int c) {
+            return qBound(0, static_cast<int>(c * (1 - factor) + gray * factor), 255);
+        };
+        return qRgba(blend(qRed(orig)), blend(qGreen(orig)), blend(qBlue(orig)), qAlpha(orig));
+    });
+}
+
+QImage ImageProcessor::applyConvolution(const QImage &image, const QVector<int> &weights, int divisor, int bias,
+                                        BorderMode border)
+{
+    QImage result;
+    applyConvolution(image, result, weights, divisor, bias, border);
     return result;
 }
 
+void ImageProcessor::applyConvolution(const QImage &image, QImage &result, const QVector<int> &weights, int divisor,
+                                      int bias, BorderMode border)
+{
+    switch (image.isNull() || divisor == 0 ? 0 : weights.size()) {
+    case 9: convolveWeights<3>(image, result, weights, divisor, bias, border); break;
+    case 25: convolveWeights<5>(image, result, weights, divisor, bias, border); break;
+    case 49: convolveWeights<7>(image, result, weights, divisor, bias, border); break;
+    default: result = image; break;
+    }
+}
+
+QImage ImageProcessor::applyInvert(const QImage &image)
+{
+    return applyColorMatrix(image, ColorMatrix::invert());
+}
+
+QImage ImageProcessor::applyWarm(const QImage &image, int intensity)
+{
+    return applyColorMatrix(image, warmMatrix(intensity));
+}
+
+QImage ImageProcessor::applyCool(const QImage &image, int intensity)
+{
+    return applyColorMatrix(image, coolMatrix(intensity));
+}
+
 QImage ImageProcessor::applyVintage(const QImage &image, int intensity)
 {
-    QImage result = applySepia(image, 70);
-    result = adjustContrast(result, 90 + intensity / 5);
-    result = applyWarm(result, intensity);
-    return result;
+    return applyColorMatrix(image, vintageMatrix(intensity));
 }
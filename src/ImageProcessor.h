@@ -3,23 +3,58 @@
 
 #include <QImage>
 #include <QColor>
+#include "ColorMatrix.h"
+#include "Convolution.h"
+#include "KernelConvolution.h"
 
 class ImageProcessor
 {
 public:
+    // Every buffer in the editing pipeline uses this format, the one
+    // QPainter composites natively; images are converted to it once on
+    // import and back to straight alpha on export. Inputs in another
+    // format are converted on entry.
+    static constexpr QImage::Format WorkingFormat = QImage::Format_ARGB32_Premultiplied;
+    
     static QImage adjustBrightness(const QImage &image, int value);
     static QImage adjustContrast(const QImage &image, int value);
     static QImage adjustSaturation(const QImage &image, int value);
+    static void applyAdjustments(const QImage &image, QImage &result, int brightness, int contrast, int saturation,
+                                 const ColorMatrix &post = ColorMatrix());
+    
+    static QImage applyColorMatrix(const QImage &image, const ColorMatrix &matrix);
+    static bool filterColorMatrix(const QString &filterName, int intensity, ColorMatrix &matrix);
     
     static QImage applyGrayscale(const QImage &image, int intensity = 100);
     static QImage applySepia(const QImage &image, int intensity = 100);
     static QImage applyBlur(const QImage &image, int radius);
-    static QImage applySharpen(const QImage &image, int intensity);
-    static QImage applyEmboss(const QImage &image, int intensity);
+    static QImage applyGaussianBlur(const QImage &image, double sigma);
+    static QImage applyUnsharpMask(const QImage &image, double radius, int amount, int threshold);
+    static QImage applyLensBlur(const QImage &image, int radius);
+    static QImage applyMotionBlur(const QImage &image, int length, double angle);
+    static QImage applyMedian(const QImage &image, int radius);
+    static QImage applySharpen(const QImage &image, int intensity, BorderMode border = BorderMode::Clamp);
+    static QImage applyEmboss(const QImage &image, int intensity, BorderMode border = BorderMode::Clamp);
+    static QImage applyConvolution(const QImage &image, const QVector<int> &weights, int divisor = 1, int bias = 0,
+                                   BorderMode border = BorderMode::Clamp);
     static QImage applyInvert(const QImage &image);
     static QImage applyWarm(const QImage &image, int intensity);
     static QImage applyCool(const QImage &image, int intensity);
     static QImage applyVintage(const QImage &image, int intensity);
+    
+    // Same as above, but write into result, reusing its buffer when it is
+    // unshared and already the right size.
+    static void applyColorMatrix(const QImage &image, QImage &result, const ColorMatrix &matrix);
+    static void applyBlur(const QImage &image, QImage &result, int radius);
+    static void applyGaussianBlur(const QImage &image, QImage &result, double sigma);
+    static void applyUnsharpMask(const QImage &image, QImage &result, double radius, int amount, int threshold);
+    static void applyLensBlur(const QImage &image, QImage &result, int radius);
+    static void applyMotionBlur(const QImage &image, QImage &result, int length, double angle);
+    static void applyMedian(const QImage &image, QImage &result, int radius);
+    static void applySharpen(const QImage &image, QImage &result, int intensity, BorderMode border = BorderMode::Clamp);
+    static void applyEmboss(const QImage &image, QImage &result, int intensity, BorderMode border = BorderMode::Clamp);
+    static void applyConvolution(const QImage &image, QImage &result, const QVector<int> &weights, int divisor = 1,
+                                 int bias = 0, BorderMode border = BorderMode::Clamp);
 };
 
 #endif // IMAGEPROCESSOR_H
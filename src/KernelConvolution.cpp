@@ -0,0 +1,368 @@
+#include "KernelConvolution.h"
+#include "Fft.h"
+#include "ImageProcessor.h"
+#include "PixelKernels.h"
+#include "ProcessingHelpers.h"
+#include "TileScheduler.h"
+#include <QtMath>
+#include <complex>
+
+// Weights are applied the way the small Convolution kernels are: weight
+// (kx, ky) multiplies the source pixel at (x + kx - width / 2, y + ky - height / 2).
+
+using ProcessingHelpers::prepareResult;
+using ProcessingHelpers::toByte;
+
+namespace {
+
+// Past this the tile no longer fits in cache and the transforms slow down
+// faster than the extra valid area pays for.
+const int MaxTileSize = 256;
+
+// Entry i + radius holds the source index for coordinate i, for
+// i in [-radius, count + radius).
+QVector<int> borderTable(int count, int radius, BorderMode border)
+{
+    QVector<int> table(count + 2 * radius);
+    for (int i = 0; i < table.size(); ++i) table[i] = Convolution::borderIndex(i - radius, count, border);
+    return table;
+}
+
+// Negative taps can leave a colour above its alpha; clamping keeps the
+// premultiplied output valid.
+void writeRow(const float *acc, uchar *out, int width)
+{
+    for (int i = 0; i < width * 4; ++i) out[i] = toByte(acc[i]);
+    PixelKernels::clampToAlpha(reinterpret_cast<QRgb*>(out), width);
+}
+
+// Estimated cost per output pixel, in flops scaled by how fast each
+// method's inner loop runs relative to the direct one.
+double directCost(const ConvolutionKernel &kernel)
+{
+    return 8.0 * kernel.width * kernel.height;
+}
+
+double separableCost(const ConvolutionKernel &kernel)
+{
+    return 8.0 * (kernel.width + kernel.height);
+}
+
+double fourierCost(const ConvolutionKernel &kernel, int *tileSize)
+{
+    const int smallest = Fft::nextPowerOfTwo(2 * qMax(kernel.width, kernel.height));
+    double best = -1;
+    for (int n = smallest; n <= qMax(smallest, MaxTileSize); n *= 2) {
+        const double area = double(n) * n;
+        const double valid = double(n - kernel.width + 1) * (n - kernel.height + 1);
+        // Two packed forward and two inverse 2-D transforms, the spectrum
+        // product and the gather/scatter of the tile.
+        const double cost = 1.5 * (4 * 5 * area * std::log2(area) + 2 * 6 * area + 16 * area) / valid;
+        if (best < 0 || cost < best) {
+            best = cost;
+            *tileSize = n;
+        }
+    }
+    return best;
+}
+
+void convolveDirect(const QImage &source, uchar *resultBits, qsizetype stride, const ConvolutionKernel &kernel,
+                    BorderMode border)
+{
+    const int width = source.width();
+    const QVector<int> xs = borderTable(width, kernel.width / 2, border);
+    const QVector<int> ys = borderTable(source.height(), kernel.height / 2, border);
+    
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        QVector<float> acc(width * 4);
+        for (int y = y0; y < y1; ++y) {
+            acc.fill(0);
+            float *a = acc.data();
+            for (int ky = 0; ky < kernel.height; ++ky) {
+                const uchar *row = source.constScanLine(ys[y + ky]);
+                for (int kx = 0; kx < kernel.width; ++kx) {
+                    const float k = kernel.at(kx, ky);
+                    if (k == 0) continue;
+                    const int *xi = xs.constData() + kx;
+                    for (int x = 0; x < width; ++x) {
+                        const uchar *p = row + xi[x] * 4;
+                        a[x * 4 + 0] += k * p[0];
+                        a[x * 4 + 1] += k * p[1];
+                        a[x * 4 + 2] += k * p[2];
+                        a[x * 4 + 3] += k * p[3];
+                    }
+                }
+            }
+            writeRow(a, resultBits + y * stride, width);
+        }
+    });
+}
+
+// Each band filters its rows plus a halo horizontally into a float buffer,
+// then runs the vertical pass out of that buffer.
+void convolveSeparable(const QImage &source, uchar *resultBits, qsizetype stride, const QVector<float> &column,
+                       const QVector<float> &row, BorderMode border)
+{
+    const int width = source.width();
+    const int rx = row.size() / 2;
+    const int ry = column.size() / 2;
+    const QVector<int> xs = borderTable(width, rx, border);
+    const QVector<int> ys = borderTable(source.height(), ry, border);
+    
+    TileScheduler::run(source.height(), [&](int y0, int y1) {
+        const int rows = y1 - y0 + 2 * ry;
+        QVector<float> horizontal(rows * width * 4, 0.0f);
+        for (int r = 0; r < rows; ++r) {
+            const uchar *in = source.constScanLine(ys[y0 + r]);
+            float *h = horizontal.data() + r * width * 4;
+            for (int kx = 0; kx < row.size(); ++kx) {
+                const float k = row[kx];
+                if (k == 0) continue;
+                const int *xi = xs.constData() + kx;
+                for (int x = 0; x < width; ++x) {
+                    const uchar *p = in + xi[x] * 4;
+                    h[x * 4 + 0] += k * p[0];
+                    h[x * 4 + 1] += k * p[1];
+                    h[x * 4 + 2] += k * p[2];
+                    h[x * 4 + 3] += k * p[3];
+                }
+            }
+        }
+        
+        QVector<float> acc(width * 4);
+        for (int y = y0; y < y1; ++y) {
+            acc.fill(0);
+            float *a = acc.data();
+            for (int ky = 0; ky < column.size(); ++ky) {
+                const float k = column[ky];
+                if (k == 0) continue;
+                const float *h = horizontal.constData() + (y - y0 + ky) * width * 4;
+                for (int i = 0; i < width * 4; ++i) a[i] += k * h[i];
+            }
+            writeRow(a, resultBits + y * stride, width);
+        }
+    }, qMax(32, 4 * ry));
+}
+
+// Overlap-save: every N x N input block (border-mapped) is transformed,
+// multiplied by the kernel spectrum and transformed back; the part of the
+// cyclic result that did not wrap is the output tile. The four channels
+// travel as two complex signals (B + iG, R + iA), which is exact because
+// the kernel is real.
+void convolveFourier(const QImage &source, uchar *resultBits, qsizetype stride, const ConvolutionKernel &kernel,
+                     BorderMode border, int tileSize)
+{
+    const int n = tileSize;
+    const int width = source.width();
+    const int height = source.height();
+    const int rx = kernel.width / 2;
+    const int ry = kernel.height / 2;
+    const int validWidth = n - kernel.width + 1;
+    const int validHeight = n - kernel.height + 1;
+    const int tilesX = (width + validWidth - 1) / validWidth;
+    const int tilesY = (height + validHeight - 1) / validHeight;
+    const Fft fft(n);
+    
+    // Flipped so the cyclic convolution applies the weights as laid out;
+    // the inverse transform's 1 / (n * n) is folded in here.
+    QVector<std::complex<float>> spectrum(n * n);
+    const float scale = 1.0f / (float(n) * n);
+    for (int ky = 0; ky < kernel.height; ++ky) {
+        for (int kx = 0; kx < kernel.width; ++kx) {
+            spectrum[(kernel.height - 1 - ky) * n + (kernel.width - 1 - kx)] = kernel.at(kx, ky) * scale;
+        }
+    }
+    fft.transform2D(spectrum.data(), false);
+    
+    // Source index for tile-relative coordinate i - radius, covering every tile.
+    QVector<int> xs((tilesX - 1) * validWidth + n), ys((tilesY - 1) * validHeight + n);
+    for (int i = 0; i < xs.size(); ++i) xs[i] = Convolution::borderIndex(i - rx, width, border);
+    for (int i = 0; i < ys.size(); ++i) ys[i] = Convolution::borderIndex(i - ry, height, border);
+    
+    TileScheduler::run(tilesX * tilesY, [&](int t0, int t1) {
+        QVector<std::complex<float>> bg(n * n), ra(n * n);
+        for (int t = t0; t < t1; ++t) {
+            const int x0 = (t % tilesX) * validWidth;
+            const int y0 = (t / tilesX) * validHeight;
+            for (int j = 0; j < n; ++j) {
+                const uchar *in = source.constScanLine(ys[y0 + j]);
+                std::complex<float> *b = bg.data() + j * n;
+                std::complex<float> *r = ra.data() + j * n;
+                for (int i = 0; i < n; ++i) {
+                    const uchar *p = in + xs[x0 + i] * 4;
+                    b[i] = std::complex<float>(p[0], p[1]);
+                    r[i] = std::complex<float>(p[2], p[3]);
+                }
+            }
+            
+            fft.transform2D(bg.data(), false);
+            fft.transform2D(ra.data(), false);
+            for (int i = 0; i < n * n; ++i) {
+                const std::complex<float> k = spectrum[i];
+                const std::complex<float> b = bg[i], r = ra[i];
+                bg[i] = std::complex<float>(b.real() * k.real() - b.imag() * k.imag(),
+                                            b.real() * k.imag() + b.imag() * k.real());
+                ra[i] = std::complex<float>(r.real() * k.real() - r.imag() * k.imag(),
+                                            r.real() * k.imag() + r.imag() * k.real());
+            }
+            fft.transform2D(bg.data(), true);
+            fft.transform2D(ra.data(), true);
+            
+            const int rows = qMin(validHeight, height - y0);
+            const int columns = qMin(validWidth, width - x0);
+            for (int j = 0; j < rows; ++j) {
+                uchar *out = resultBits + (y0 + j) * stride + x0 * 4;
+                const std::complex<float> *b = bg.constData() + (j + kernel.height - 1) * n + kernel.width - 1;
+                const std::complex<float> *r = ra.constData() + (j + kernel.height - 1) * n + kernel.width - 1;
+                for (int i = 0; i < columns; ++i) {
+                    out[i * 4 + 0] = toByte(b[i].real());
+                    out[i * 4 + 1] = toByte(b[i].imag());
+                    out[i * 4 + 2] = toByte(r[i].real());
+                    out[i * 4 + 3] = toByte(r[i].imag());
+                }
+                PixelKernels::clampToAlpha(reinterpret_cast<QRgb*>(out), columns);
+            }
+        }
+    }, 1);
+}
+
+} // namespace
+
+bool ConvolutionKernel::isValid() const
+{
+    return width > 0 && height > 0 && (width % 2) == 1 && (height % 2) == 1 && weights.size() == width * height;
+}
+
+ConvolutionKernel ConvolutionKernel::disc(int radius)
+{
+    ConvolutionKernel kernel;
+    kernel.width = kernel.height = 2 * qMax(0, radius) + 1;
+    kernel.weights.resize(kernel.width * kernel.height);
+    
+    // Edge pixels get partial weight from a 4x4 supersample, which keeps
+    // the bokeh round instead of stair-stepped.
+    double total = 0;
+    for (int y = 0; y < kernel.height; ++y) {
+        for (int x = 0; x < kernel.width; ++x) {
+            int inside = 0;
+            for (int sy = 0; sy < 4; ++sy) {
+                for (int sx = 0; sx < 4; ++sx) {
+                    double dx = x - radius + (sx + 0.5) / 4 - 0.5;
+                    double dy = y - radius + (sy + 0.5) / 4 - 0.5;
+                    if (dx * dx + dy * dy <= (radius + 0.5) * (radius + 0.5)) ++inside;
+                }
+            }
+            kernel.weights[y * kernel.width + x] = inside;
+            total += inside;
+        }
+    }
+    for (float &w : kernel.weights) w = static_cast<float>(w / total);
+    return kernel;
+}
+
+ConvolutionKernel ConvolutionKernel::motion(int length, double angleDegrees)
+{
+    length = qMax(1, length);
+    ConvolutionKernel kernel;
+    kernel.width = kernel.height = length | 1;
+    kernel.weights.fill(0.0f, kernel.width * kernel.height);
+    
+    const double centre = kernel.width / 2;
+    const double angle = qDegreesToRadians(angleDegrees);
+    const double dx = qCos(angle);
+    const double dy = -qSin(angle);
+    const int samples = length * 4;
+    double total = 0;
+    for (int s = 0; s < samples; ++s) {
+        double t = (s + 0.5) / samples * (length - 1) - (length - 1) / 2.0;
+        double px = centre + t * dx;
+        double py = centre + t * dy;
+        int ix = qFloor(px), iy = qFloor(py);
+        double fx = px - ix, fy = py - iy;
+        const double splat[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+        for (int k = 0; k < 4; ++k) {
+            int x = ix + (k & 1), y = iy + (k >> 1);
+            if (x < 0 || y < 0 || x >= kernel.width || y >= kernel.height) continue;
+            kernel.weights[y * kernel.width + x] += static_cast<float>(splat[k]);
+            total += splat[k];
+        }
+    }
+    for (float &w : kernel.weights) w = static_cast<float>(w / total);
+    return kernel;
+}
+
+KernelConvolution::Method KernelConvolution::chooseMethod(const ConvolutionKernel &kernel)
+{
+    QVector<float> column, row;
+    int tileSize = 0;
+    double direct = directCost(kernel);
+    double fourier = fourierCost(kernel, &tileSize);
+    double separable = separate(kernel, column, row) ? separableCost(kernel) : -1;
+    
+    if (separable >= 0 && separable <= direct && separable <= fourier) return Separable;
+    return direct <= fourier ? Direct : FourierTiles;
+}
+
+bool KernelConvolution::separate(const ConvolutionKernel &kernel, QVector<float> &column, QVector<float> &row)
+{
+    if (!kernel.isValid()) return false;
+    
+    int pivotX = 0, pivotY = 0;
+    float largest = 0;
+    for (int y = 0; y < kernel.height; ++y) {
+        for (int x = 0; x < kernel.width; ++x) {
+            if (qAbs(kernel.at(x, y)) > largest) {
+                largest = qAbs(kernel.at(x, y));
+                pivotX = x;
+                pivotY = y;
+            }
+        }
+    }
+    if (largest == 0) return false;
+    
+    column.resize(kernel.height);
+    row.resize(kernel.width);
+    for (int y = 0; y < kernel.height; ++y) column[y] = kernel.at(pivotX, y);
+    for (int x = 0; x < kernel.width; ++x) row[x] = kernel.at(x, pivotY) / kernel.at(pivotX, pivotY);
+    
+    const float tolerance = largest * 1e-5f;
+    for (int y = 0; y < kernel.height; ++y) {
+        for (int x = 0; x < kernel.width; ++x) {
+            if (qAbs(kernel.at(x, y) - column[y] * row[x]) > tolerance) return false;
+        }
+    }
+    return true;
+}
+
+void KernelConvolution::apply(const QImage &image, QImage &result, const ConvolutionKernel &kernel,
+                              BorderMode border, Method method)
+{
+    if (image.isNull() || !kernel.isValid()) {
+        result = image;
+        return;
+    }
+    
+    QImage source = image.convertToFormat(ImageProcessor::WorkingFormat);
+    prepareResult(source.size(), result);
+    uchar *resultBits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    
+    QVector<float> column, row;
+    if (method == Automatic) method = chooseMethod(kernel);
+    if (method == Separable && !separate(kernel, column, row)) method = Direct;
+    
+    switch (method) {
+    case Separable:
+        convolveSeparable(source, resultBits, stride, column, row, border);
+        break;
+    case FourierTiles: {
+        int tileSize = 0;
+        fourierCost(kernel, &tileSize);
+        convolveFourier(source, resultBits, stride, kernel, border, tileSize);
+        break;
+    }
+    default:
+        convolveDirect(source, resultBits, stride, kernel, border);
+        break;
+    }
+}
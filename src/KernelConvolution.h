@@ -0,0 +1,44 @@
+#ifndef KERNELCONVOLUTION_H
+#define KERNELCONVOLUTION_H
+
+#include <QImage>
+#include <QVector>
+#include "Convolution.h"
+
+// Arbitrary-size floating point kernel, row-major, odd width and height,
+// centred on (width / 2, height / 2).
+struct ConvolutionKernel
+{
+    int width = 0;
+    int height = 0;
+    QVector<float> weights;
+    
+    float at(int x, int y) const { return weights[y * width + x]; }
+    bool isValid() const;
+    
+    static ConvolutionKernel disc(int radius);
+    static ConvolutionKernel motion(int length, double angleDegrees);
+};
+
+// Convolution with large or user-supplied kernels. Automatic picks the
+// cheapest method from a rough flop count: direct for small kernels, two
+// 1-D passes when the kernel is rank one, and tiled FFT overlap-save
+// otherwise. All methods run on TileScheduler.
+class KernelConvolution
+{
+public:
+    enum Method {
+        Automatic,
+        Direct,
+        Separable,
+        FourierTiles
+    };
+    
+    static Method chooseMethod(const ConvolutionKernel &kernel);
+    static bool separate(const ConvolutionKernel &kernel, QVector<float> &column, QVector<float> &row);
+    
+    static void apply(const QImage &image, QImage &result, const ConvolutionKernel &kernel,
+                      BorderMode border = BorderMode::Clamp, Method method = Automatic);
+};
+
+#endif // KERNELCONVOLUTION_H
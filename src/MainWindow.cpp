@@ -13,11 +13,12 @@
 #include <QPrintDialog>
 #include <QPrinter>
 #include <QPainter>
+#include "ImageProcessor.h"
+#include "UndoStore.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_canvas(nullptr)
-    , m_scrollArea(nullptr)
     , m_adjustmentPanel(nullptr)
     , m_filterPanel(nullptr)
     , m_toolOptionsPanel(nullptr)
@@ -34,12 +35,7 @@ void MainWindow::setupUi()
     resize(1200, 800);
     
     m_canvas = new ImageCanvas(this);
-    m_scrollArea = new QScrollArea(this);
-    m_scrollArea->setWidget(m_canvas);
-    m_scrollArea->setWidgetResizable(false);
-    m_scrollArea->setAlignment(Qt::AlignCenter);
-    m_scrollArea->setStyleSheet("QScrollArea { background: #2b2b2b; }");
-    setCentralWidget(m_scrollArea);
+    setCentralWidget(m_canvas);
     
     setupMenuBar();
     setupToolBar();
@@ -51,6 +47,32 @@ void MainWindow::setupUi()
     statusBar()->addWidget(m_statusLabel, 1);
     statusBar()->addPermanentWidget(m_zoomLabel);
     
+    // Undo history compresses and spills in the background; poll its size.
+    m_historyLabel = new QLabel();
+    statusBar()->addPermanentWidget(m_historyLabel);
+    m_historyTimer = new QTimer(this);
+    m_historyTimer->setInterval(1000);
+    connect(m_historyTimer, &QTimer::timeout, this, &MainWindow::updateHistoryLabel);
+    m_historyTimer->start();
+    updateHistoryLabel();
+    
+    // Busy indicator for background renders; only shown for ones slow
+    // enough to notice, so quick slider steps don't make it flicker.
+    m_renderProgress = new QProgressBar();
+    m_renderProgress->setRange(0, 0);
+    m_renderProgress->setFixedWidth(120);
+    m_renderProgress->hide();
+    statusBar()->addPermanentWidget(m_renderProgress);
+    m_renderProgressDelay = new QTimer(this);
+    m_renderProgressDelay->setSingleShot(true);
+    m_renderProgressDelay->setInterval(150);
+    connect(m_renderProgressDelay, &QTimer::timeout, m_renderProgress, &QProgressBar::show);
+    connect(m_canvas, &ImageCanvas::renderStarted, m_renderProgressDelay, QOverload<>::of(&QTimer::start));
+    connect(m_canvas, &ImageCanvas::renderFinished, this, [this]() {
+        m_renderProgressDelay->stop();
+        m_renderProgress->hide();
+    });
+    
     updateActionsState();
 }
 
@@ -208,6 +230,18 @@ void MainWindow::updateZoomLabel()
     }
 }
 
+void MainWindow::updateHistoryLabel()
+{
+    const UndoStore::Usage usage = UndoStore::usage();
+    const double mb = 1024.0 * 1024.0;
+    QString text = QString("历史: 内存 %1 MB（压缩 %2 MB）· 磁盘 %3 MB")
+                   .arg((usage.raw + usage.compressed) / mb, 0, 'f', 0)
+                   .arg(usage.compressed / mb, 0, 'f', 0)
+                   .arg(usage.disk / mb, 0, 'f', 0);
+    if (usage.spillFailed) text += " · 临时文件写入失败，超出上限时丢弃最早的历史";
+    m_historyLabel->setText(text);
+}
+
 void MainWindow::setupDockWidgets()
 {
     m_adjustmentPanel = new AdjustmentPanel(this);
@@ -239,13 +273,23 @@ void MainWindow::setupConnections()
     connect(m_adjustmentPanel, &AdjustmentPanel::contrastChanged, m_canvas, &ImageCanvas::setContrast);
     connect(m_adjustmentPanel, &AdjustmentPanel::saturationChanged, m_canvas, &ImageCanvas::setSaturation);
     connect(m_adjustmentPanel, &AdjustmentPanel::resetRequested, m_canvas, &ImageCanvas::resetAdjustments);
+    connect(m_adjustmentPanel, &AdjustmentPanel::interactionStarted, m_canvas, &ImageCanvas::beginInteractivePreview);
+    connect(m_adjustmentPanel, &AdjustmentPanel::interactionFinished, m_canvas, &ImageCanvas::endInteractivePreview);
     
     connect(m_filterPanel, &FilterPanel::filterSelected, m_canvas, &ImageCanvas::applyFilter);
     connect(m_filterPanel, &FilterPanel::intensityChanged, m_canvas, &ImageCanvas::setFilterIntensity);
+    connect(m_filterPanel, &FilterPanel::radiusChanged, m_canvas, &ImageCanvas::setFilterRadius);
+    connect(m_filterPanel, &FilterPanel::thresholdChanged, m_canvas, &ImageCanvas::setFilterThreshold);
+    connect(m_filterPanel, &FilterPanel::angleChanged, m_canvas, &ImageCanvas::setFilterAngle);
+    connect(m_filterPanel, &FilterPanel::interactionStarted, m_canvas, &ImageCanvas::beginInteractivePreview);
+    connect(m_filterPanel, &FilterPanel::interactionFinished, m_canvas, &ImageCanvas::endInteractivePreview);
     
     connect(m_toolOptionsPanel, &ToolOptionsPanel::brushSizeChanged, m_canvas, &ImageCanvas::setBrushSize);
     connect(m_toolOptionsPanel, &ToolOptionsPanel::brushColorChanged, m_canvas, &ImageCanvas::setBrushColor);
     connect(m_toolOptionsPanel, &ToolOptionsPanel::eraserSizeChanged, m_canvas, &ImageCanvas::setEraserSize);
+    connect(m_toolOptionsPanel, &ToolOptionsPanel::brushHardnessChanged, m_canvas, &ImageCanvas::setBrushHardness);
+    connect(m_toolOptionsPanel, &ToolOptionsPanel::brushSpacingChanged, m_canvas, &ImageCanvas::setBrushSpacing);
+    connect(m_toolOptionsPanel, &ToolOptionsPanel::brushFlowChanged, m_canvas, &ImageCanvas::setBrushFlow);
     
     connect(m_toolGroup, &QActionGroup::triggered, this, [this](QAction *action) {
         m_canvas->setTool(static_cast<ToolType>(action->data().toInt()));
@@ -322,7 +366,11 @@ void MainWindow::newImage()
     int h = QInputDialog::getInt(this, "新建图像", "高度:", 600, 1, 10000, 1, &ok);
     if (!ok) return;
     
-    QImage img(w, h, QImage::Format_ARGB32);
+    QImage img(w, h, ImageProcessor::WorkingFormat);
+    if (img.isNull()) {
+        QMessageBox::warning(this, "PhotoEditor", QString("内存不足，无法创建 %1×%2 的图像").arg(w).arg(h));
+        return;
+    }
     img.fill(Qt::white);
     m_canvas->loadImage(img);
     setCurrentFile(QString());
@@ -4,11 +4,12 @@
 #include <QMainWindow>
 #include <QCloseEvent>
 #include <QLabel>
+#include <QProgressBar>
+#include <QTimer>
 #include <QImage>
 #include <QActionGroup>
 #include <QSlider>
 #include <QSpinBox>
-#include <QScrollArea>
 #include "ImageCanvas.h"
 #include "AdjustmentPanel.h"
 #include "FilterPanel.h"
@@ -71,7 +72,6 @@ private:
     void setCurrentFile(const QString &fileName);
 
     ImageCanvas *m_canvas;
-    QScrollArea *m_scrollArea;
     AdjustmentPanel *m_adjustmentPanel;
     FilterPanel *m_filterPanel;
     ToolOptionsPanel *m_toolOptionsPanel;
@@ -87,8 +87,13 @@ private:
     
     QLabel *m_statusLabel;
     QLabel *m_zoomLabel;
+    QLabel *m_historyLabel;
+    QTimer *m_historyTimer;
+    QProgressBar *m_renderProgress;
+    QTimer *m_renderProgressDelay;
     
     void updateZoomLabel();
+    void updateHistoryLabel();
     
     QString m_currentFile;
     QString m_lastDirectory;
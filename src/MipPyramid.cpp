@@ -0,0 +1,84 @@
+#include "MipPyramid.h"
+#include "TileScheduler.h"
+#include <QtMath>
+
+namespace {
+
+// Averages 2x2 blocks of `src` into the `rect` of `dst`. The pixels are
+// premultiplied, so a plain average of every channel already weights
+// colour by coverage.
+void reduce(const QImage &src, QImage &dst, const QRect &rect)
+{
+    const int lastX = src.width() - 1;
+    const int lastY = src.height() - 1;
+    TileScheduler::run(rect.height(), [&](int y0, int y1) {
+        for (int y = rect.top() + y0; y < rect.top() + y1; ++y) {
+            const uchar *row0 = src.constScanLine(qMin(2 * y, lastY));
+            const uchar *row1 = src.constScanLine(qMin(2 * y + 1, lastY));
+            uchar *out = dst.scanLine(y);
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                const int x0 = qMin(2 * x, lastX) * 4;
+                const int x1 = qMin(2 * x + 1, lastX) * 4;
+                for (int c = 0; c < 4; ++c) {
+                    out[x * 4 + c] = static_cast<uchar>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+            }
+        }
+    }, 8);
+}
+
+} // namespace
+
+void MipPyramid::clear()
+{
+    m_levels.clear();
+    m_dirty.clear();
+}
+
+void MipPyramid::markDirty(const QRect &rect)
+{
+    for (QRect &dirty : m_dirty) dirty |= rect;
+}
+
+const QImage &MipPyramid::level(const QImage &base, double scale, double *levelScale)
+{
+    int index = 0;
+    double current = 1.0;
+    while (current * 0.5 >= scale && base.width() * current * 0.5 >= 1.0 && base.height() * current * 0.5 >= 1.0) {
+        current *= 0.5;
+        ++index;
+    }
+    if (levelScale) *levelScale = 1.0;
+    if (index == 0 || base.isNull()) return base;
+    
+    for (int i = 1; i <= index; ++i) refresh(base, i);
+    // Odd sizes round up, so a level may hold half a pixel of padding at its
+    // right and bottom edges; its scale is still exactly a power of two.
+    if (levelScale) *levelScale = current;
+    return m_levels[index - 1];
+}
+
+void MipPyramid::refresh(const QImage &base, int index)
+{
+    const QSize srcSize = index == 1 ? base.size() : m_levels[index - 2].size();
+    const QSize size((srcSize.width() + 1) / 2, (srcSize.height() + 1) / 2);
+    
+    if (m_levels.size() < index) {
+        m_levels.append(QImage(size, base.format()));
+        m_dirty.append(base.rect());
+    } else if (m_levels[index - 1].size() != size) {
+        m_levels[index - 1] = QImage(size, base.format());
+        m_dirty[index - 1] = base.rect();
+    }
+    
+    const QImage &src = index == 1 ? base : m_levels[index - 2];
+    QRect &dirty = m_dirty[index - 1];
+    if (dirty.isEmpty()) return;
+    
+    // Level pixel i covers base pixels [i << index, (i + 1) << index).
+    const QRect area = QRect(QPoint(dirty.left() >> index, dirty.top() >> index),
+                             QPoint(dirty.right() >> index, dirty.bottom() >> index))
+                       & m_levels[index - 1].rect();
+    reduce(src, m_levels[index - 1], area);
+    dirty = QRect();
+}
@@ -0,0 +1,35 @@
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+// Box-filtered reductions of a display image: level 1 is half size, level 2
+// a quarter, and so on. Levels are built the first time they're asked for
+// and afterwards only the regions reported through markDirty() are
+// refreshed, level by level, when a level is next needed. The base image is
+// not stored, so the owner can keep painting into it without a detach copy;
+// it passes the base back in on every call.
+class MipPyramid
+{
+public:
+    // Drops every level; call when the base is replaced.
+    void clear();
+    // Records that `rect` (base coordinates) of the base changed.
+    void markDirty(const QRect &rect);
+    
+    // Returns the smallest level that still has at least `scale` times the
+    // base resolution, and its scale (a power of two) in *levelScale. Returns the base
+    // itself when no reduction is small enough to help.
+    const QImage &level(const QImage &base, double scale, double *levelScale);
+
+private:
+    void refresh(const QImage &base, int index);
+    
+    QVector<QImage> m_levels;
+    // Changed area per level, kept in base coordinates.
+    QVector<QRect> m_dirty;
+};
+
+#endif // MIPPYRAMID_H
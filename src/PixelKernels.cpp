@@ -0,0 +1,435 @@
+#include "PixelKernels.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define PIXELKERNELS_SSE2
+#  include <emmintrin.h>
+#endif
+
+#if defined(PHOTOEDITOR_HAVE_AVX2)
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#    include <immintrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+
+int addChannelsAvx2(const QRgb *src, QRgb *dst, int count, quint32 add, quint32 sub);
+int invertAvx2(const QRgb *src, QRgb *dst, int count);
+int mixChannelsAvx2(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix);
+int blendMaskAvx2(QRgb *dst, const quint8 *mask, int count, QRgb color, float coverageScale);
+int eraseMaskAvx2(QRgb *dst, const quint8 *mask, int count, float coverageScale);
+#endif
+
+namespace {
+
+bool cpuHasAvx2()
+{
+#if defined(PHOTOEDITOR_HAVE_AVX2)
+#  if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#  else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    const bool osxsave = (ecx & (1u << 27)) != 0;
+    const bool avx = (ecx & (1u << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    unsigned int xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    if ((xcr0Low & 0x6) != 0x6) return false;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ebx & (1u << 5)) != 0;
+#  endif
+#else
+    return false;
+#endif
+}
+
+PixelKernels::Isa detectIsa()
+{
+    if (cpuHasAvx2()) return PixelKernels::Avx2;
+#if defined(PIXELKERNELS_SSE2)
+    return PixelKernels::Sse2;
+#else
+    return PixelKernels::Scalar;
+#endif
+}
+
+PixelKernels::Isa &currentIsa()
+{
+    static PixelKernels::Isa isa = PixelKernels::supportedIsa();
+    return isa;
+}
+
+quint32 packRgb(int r, int g, int b)
+{
+    return (quint32(qBound(0, r, 255)) << 16) | (quint32(qBound(0, g, 255)) << 8) | quint32(qBound(0, b, 255));
+}
+
+void addChannelsScalar(const QRgb *src, QRgb *dst, int count, int dr, int dg, int db)
+{
+    for (int i = 0; i < count; ++i) {
+        QRgb p = src[i];
+        int r = qBound(0, qRed(p) + dr, 255);
+        int g = qBound(0, qGreen(p) + dg, 255);
+        int b = qBound(0, qBlue(p) + db, 255);
+        dst[i] = qRgba(r, g, b, qAlpha(p));
+    }
+}
+
+void invertScalar(const QRgb *src, QRgb *dst, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        QRgb p = src[i];
+        dst[i] = qRgba(255 - qRed(p), 255 - qGreen(p), 255 - qBlue(p), qAlpha(p));
+    }
+}
+
+void mixChannelsScalar(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix)
+{
+    const qint64 round = ColorMatrix::One / 2;
+    for (int i = 0; i < count; ++i) {
+        QRgb p = src[i];
+        const int in[4] = {qRed(p), qGreen(p), qBlue(p), qAlpha(p)};
+        int out[4];
+        for (int c = 0; c < 4; ++c) {
+            qint64 sum = static_cast<qint64>(matrix.at(c, 0)) * in[0] + static_cast<qint64>(matrix.at(c, 1)) * in[1]
+                       + static_cast<qint64>(matrix.at(c, 2)) * in[2] + static_cast<qint64>(matrix.at(c, 3)) * in[3]
+                       + matrix.at(c, 4) + round;
+            out[c] = static_cast<int>(qBound<qint64>(0, sum >> ColorMatrix::Shift, 255));
+        }
+        dst[i] = qRgba(out[0], out[1], out[2], out[3]);
+    }
+}
+
+// Premultiplied source-over in float: every channel, alpha included, moves
+// from the destination toward the opaque brush colour by the dab coverage.
+// The SIMD versions do the same operations in the same order, so every ISA
+// produces identical bytes.
+void blendMaskScalar(QRgb *dst, const quint8 *mask, int count, QRgb color, float coverageScale)
+{
+    const float cr = float(qRed(color));
+    const float cg = float(qGreen(color));
+    const float cb = float(qBlue(color));
+    for (int i = 0; i < count; ++i) {
+        const QRgb p = dst[i];
+        const float s = float(mask[i]) * coverageScale;
+        const float keep = 1.0f - s;
+        const int r = int(float(qRed(p)) * keep + cr * s + 0.5f);
+        const int g = int(float(qGreen(p)) * keep + cg * s + 0.5f);
+        const int b = int(float(qBlue(p)) * keep + cb * s + 0.5f);
+        const int a = int(float(qAlpha(p)) * keep + 255.0f * s + 0.5f);
+        dst[i] = qRgba(r, g, b, a);
+    }
+}
+
+// Scales all four premultiplied channels, so a fully erased pixel ends up
+// as transparent black rather than keeping its old colour.
+void eraseMaskScalar(QRgb *dst, const quint8 *mask, int count, float coverageScale)
+{
+    for (int i = 0; i < count; ++i) {
+        const QRgb p = dst[i];
+        const float keep = 1.0f - float(mask[i]) * coverageScale;
+        const int r = int(float(qRed(p)) * keep + 0.5f);
+        const int g = int(float(qGreen(p)) * keep + 0.5f);
+        const int b = int(float(qBlue(p)) * keep + 0.5f);
+        const int a = int(float(qAlpha(p)) * keep + 0.5f);
+        dst[i] = qRgba(r, g, b, a);
+    }
+}
+
+#if defined(PIXELKERNELS_SSE2)
+int addChannelsSse2(const QRgb *src, QRgb *dst, int count, quint32 add, quint32 sub)
+{
+    const __m128i vadd = _mm_set1_epi32(static_cast<int>(add));
+    const __m128i vsub = _mm_set1_epi32(static_cast<int>(sub));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        v = _mm_subs_epu8(_mm_adds_epu8(v, vadd), vsub);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    return i;
+}
+
+int invertSse2(const QRgb *src, QRgb *dst, int count)
+{
+    const __m128i mask = _mm_set1_epi32(0x00ffffff);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(v, mask));
+    }
+    return i;
+}
+
+inline __m128i mixPlaneSse2(__m128i rgLo, __m128i rgHi, __m128i baLo, __m128i baHi,
+                            __m128i coefRG, __m128i coefBA, __m128i offset)
+{
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(rgLo, coefRG), _mm_madd_epi16(baLo, coefBA));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(rgHi, coefRG), _mm_madd_epi16(baHi, coefBA));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, offset), ColorMatrix::Shift);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, offset), ColorMatrix::Shift);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    return _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(lo, hi), zero), max);
+}
+
+int mixChannelsSse2(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix)
+{
+    __m128i coefRG[4], coefBA[4], offset[4];
+    for (int c = 0; c < 4; ++c) {
+        quint32 rg = quint32(quint16(matrix.at(c, 0))) | (quint32(quint16(matrix.at(c, 1))) << 16);
+        quint32 ba = quint32(quint16(matrix.at(c, 2))) | (quint32(quint16(matrix.at(c, 3))) << 16);
+        coefRG[c] = _mm_set1_epi32(static_cast<int>(rg));
+        coefBA[c] = _mm_set1_epi32(static_cast<int>(ba));
+        offset[c] = _mm_set1_epi32(matrix.at(c, 4) + ColorMatrix::One / 2);
+    }
+    const bool keepAlpha = matrix.isAlphaPreserving();
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+        __m128i b = _mm_packs_epi32(_mm_and_si128(p0, byteMask), _mm_and_si128(p1, byteMask));
+        __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), byteMask),
+                                    _mm_and_si128(_mm_srli_epi32(p1, 8), byteMask));
+        __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), byteMask),
+                                    _mm_and_si128(_mm_srli_epi32(p1, 16), byteMask));
+        __m128i a = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+
+        __m128i rgLo = _mm_unpacklo_epi16(r, g);
+        __m128i rgHi = _mm_unpackhi_epi16(r, g);
+        __m128i baLo = _mm_unpacklo_epi16(b, a);
+        __m128i baHi = _mm_unpackhi_epi16(b, a);
+
+        __m128i outR = mixPlaneSse2(rgLo, rgHi, baLo, baHi, coefRG[0], coefBA[0], offset[0]);
+        __m128i outG = mixPlaneSse2(rgLo, rgHi, baLo, baHi, coefRG[1], coefBA[1], offset[1]);
+        __m128i outB = mixPlaneSse2(rgLo, rgHi, baLo, baHi, coefRG[2], coefBA[2], offset[2]);
+        __m128i outA = keepAlpha ? a : mixPlaneSse2(rgLo, rgHi, baLo, baHi, coefRG[3], coefBA[3], offset[3]);
+
+        __m128i bg = _mm_or_si128(outB, _mm_slli_epi16(outG, 8));
+        __m128i ra = _mm_or_si128(outR, _mm_slli_epi16(outA, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+    return i;
+}
+
+inline __m128 channelSse2(__m128i pixels, int shift)
+{
+    return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, shift), _mm_set1_epi32(0xff)));
+}
+
+inline __m128 coverageSse2(const quint8 *mask, __m128 scale)
+{
+    int bytes;
+    memcpy(&bytes, mask, sizeof(bytes));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    return _mm_mul_ps(_mm_cvtepi32_ps(m), scale);
+}
+
+inline __m128i roundSse2(__m128 v)
+{
+    return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+}
+
+int blendMaskSse2(QRgb *dst, const quint8 *mask, int count, QRgb color, float coverageScale)
+{
+    const __m128 scale = _mm_set1_ps(coverageScale);
+    const __m128 cr = _mm_set1_ps(float(qRed(color)));
+    const __m128 cg = _mm_set1_ps(float(qGreen(color)));
+    const __m128 cb = _mm_set1_ps(float(qBlue(color)));
+    const __m128 ca = _mm_set1_ps(255.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128 s = coverageSse2(mask + i, scale);
+        __m128 keep = _mm_sub_ps(one, s);
+        __m128i r = roundSse2(_mm_add_ps(_mm_mul_ps(channelSse2(p, 16), keep), _mm_mul_ps(cr, s)));
+        __m128i g = roundSse2(_mm_add_ps(_mm_mul_ps(channelSse2(p, 8), keep), _mm_mul_ps(cg, s)));
+        __m128i b = roundSse2(_mm_add_ps(_mm_mul_ps(channelSse2(p, 0), keep), _mm_mul_ps(cb, s)));
+        __m128i a = roundSse2(_mm_add_ps(_mm_mul_ps(channelSse2(p, 24), keep), _mm_mul_ps(ca, s)));
+        __m128i out = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 8)),
+                                   _mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(a, 24)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), out);
+    }
+    return i;
+}
+
+int eraseMaskSse2(QRgb *dst, const quint8 *mask, int count, float coverageScale)
+{
+    const __m128 scale = _mm_set1_ps(coverageScale);
+    const __m128 one = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128 keep = _mm_sub_ps(one, coverageSse2(mask + i, scale));
+        __m128i r = roundSse2(_mm_mul_ps(channelSse2(p, 16), keep));
+        __m128i g = roundSse2(_mm_mul_ps(channelSse2(p, 8), keep));
+        __m128i b = roundSse2(_mm_mul_ps(channelSse2(p, 0), keep));
+        __m128i a = roundSse2(_mm_mul_ps(channelSse2(p, 24), keep));
+        __m128i out = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 8)),
+                                   _mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(a, 24)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), out);
+    }
+    return i;
+}
+#endif
+
+} // namespace
+
+PixelKernels::Isa PixelKernels::supportedIsa()
+{
+    static const Isa isa = detectIsa();
+    return isa;
+}
+
+PixelKernels::Isa PixelKernels::activeIsa()
+{
+    return currentIsa();
+}
+
+void PixelKernels::setIsa(Isa isa)
+{
+    currentIsa() = qMin(isa, supportedIsa());
+}
+
+void PixelKernels::addChannels(const QRgb *src, QRgb *dst, int count, int dr, int dg, int db)
+{
+    int done = 0;
+    const quint32 add = packRgb(dr, dg, db);
+    const quint32 sub = packRgb(-dr, -dg, -db);
+    switch (currentIsa()) {
+#if defined(PHOTOEDITOR_HAVE_AVX2)
+    case Avx2: done = addChannelsAvx2(src, dst, count, add, sub); break;
+#endif
+#if defined(PIXELKERNELS_SSE2)
+    case Sse2: done = addChannelsSse2(src, dst, count, add, sub); break;
+#endif
+    default: break;
+    }
+    addChannelsScalar(src + done, dst + done, count - done, dr, dg, db);
+}
+
+void PixelKernels::invert(const QRgb *src, QRgb *dst, int count)
+{
+    int done = 0;
+    switch (currentIsa()) {
+#if defined(PHOTOEDITOR_HAVE_AVX2)
+    case Avx2: done = invertAvx2(src, dst, count); break;
+#endif
+#if defined(PIXELKERNELS_SSE2)
+    case Sse2: done = invertSse2(src, dst, count); break;
+#endif
+    default: break;
+    }
+    invertScalar(src + done, dst + done, count - done);
+}
+
+void PixelKernels::mixChannels(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix)
+{
+    int done = 0;
+    if (matrix.fitsInt16()) {
+        switch (currentIsa()) {
+#if defined(PHOTOEDITOR_HAVE_AVX2)
+        case Avx2: done = mixChannelsAvx2(src, dst, count, matrix); break;
+#endif
+#if defined(PIXELKERNELS_SSE2)
+        case Sse2: done = mixChannelsSse2(src, dst, count, matrix); break;
+#endif
+        default: break;
+        }
+    }
+    mixChannelsScalar(src + done, dst + done, count - done, matrix);
+}
+
+void PixelKernels::applyColorMatrix(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix)
+{
+    if (matrix.isIdentity()) {
+        if (src != dst) memcpy(dst, src, static_cast<size_t>(count) * sizeof(QRgb));
+    } else if (matrix.isTranslation()) {
+        addChannels(src, dst, count, matrix.at(0, 4) / ColorMatrix::One,
+                    matrix.at(1, 4) / ColorMatrix::One, matrix.at(2, 4) / ColorMatrix::One);
+    } else if (matrix.isInvert()) {
+        invert(src, dst, count);
+    } else {
+        mixChannels(src, dst, count, matrix);
+    }
+}
+
+bool PixelKernels::isOpaque(const QRgb *src, int count)
+{
+    QRgb all = 0xff000000;
+    for (int i = 0; i < count; ++i) all &= src[i];
+    return qAlpha(all) == 255;
+}
+
+void PixelKernels::unpremultiply(const QRgb *src, QRgb *dst, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const QRgb p = src[i];
+        dst[i] = qAlpha(p) == 255 ? p : qUnpremultiply(p);
+    }
+}
+
+void PixelKernels::premultiply(const QRgb *src, QRgb *dst, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const QRgb p = src[i];
+        dst[i] = qAlpha(p) == 255 ? p : qPremultiply(p);
+    }
+}
+
+void PixelKernels::clampToAlpha(QRgb *pixels, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const QRgb p = pixels[i];
+        const int a = qAlpha(p);
+        if (a == 255) continue;
+        pixels[i] = qRgba(qMin(qRed(p), a), qMin(qGreen(p), a), qMin(qBlue(p), a), a);
+    }
+}
+
+void PixelKernels::blendMask(QRgb *dst, const quint8 *mask, int count, QRgb color, int opacity)
+{
+    const float coverageScale = float(qBound(0, opacity, 255) * qAlpha(color)) / (255.0f * 255.0f * 255.0f);
+    int done = 0;
+    switch (currentIsa()) {
+#if defined(PHOTOEDITOR_HAVE_AVX2)
+    case Avx2: done = blendMaskAvx2(dst, mask, count, color, coverageScale); break;
+#endif
+#if defined(PIXELKERNELS_SSE2)
+    case Sse2: done = blendMaskSse2(dst, mask, count, color, coverageScale); break;
+#endif
+    default: break;
+    }
+    blendMaskScalar(dst + done, mask + done, count - done, color, coverageScale);
+}
+
+void PixelKernels::eraseMask(QRgb *dst, const quint8 *mask, int count, int opacity)
+{
+    const float coverageScale = float(qBound(0, opacity, 255)) / (255.0f * 255.0f);
+    int done = 0;
+    switch (currentIsa()) {
+#if defined(PHOTOEDITOR_HAVE_AVX2)
+    case Avx2: done = eraseMaskAvx2(dst, mask, count, coverageScale); break;
+#endif
+#if defined(PIXELKERNELS_SSE2)
+    case Sse2: done = eraseMaskSse2(dst, mask, count, coverageScale); break;
+#endif
+    default: break;
+    }
+    eraseMaskScalar(dst + done, mask + done, count - done, coverageScale);
+}
@@ -0,0 +1,42 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <QtGlobal>
+#include <QColor>
+#include "ColorMatrix.h"
+
+class PixelKernels
+{
+public:
+    enum Isa {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    static Isa supportedIsa();
+    static Isa activeIsa();
+    static void setIsa(Isa isa);
+
+    static void addChannels(const QRgb *src, QRgb *dst, int count, int dr, int dg, int db);
+    static void invert(const QRgb *src, QRgb *dst, int count);
+    static void mixChannels(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix);
+    static void applyColorMatrix(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix);
+
+    // The colour kernels above work on straight colour; these convert rows
+    // of premultiplied pixels around them. src and dst may be the same row.
+    // Opaque pixels are returned unchanged.
+    static bool isOpaque(const QRgb *src, int count);
+    static void unpremultiply(const QRgb *src, QRgb *dst, int count);
+    static void premultiply(const QRgb *src, QRgb *dst, int count);
+    // Caps each colour channel at the pixel's alpha, restoring a valid
+    // premultiplied pixel after a filter with negative weights.
+    static void clampToAlpha(QRgb *pixels, int count);
+
+    // In-place compositing through an 8-bit coverage mask on premultiplied
+    // ARGB32. The colour is straight; opacity scales the mask, 0-255.
+    static void blendMask(QRgb *dst, const quint8 *mask, int count, QRgb color, int opacity);
+    static void eraseMask(QRgb *dst, const quint8 *mask, int count, int opacity);
+};
+
+#endif // PIXELKERNELS_H
@@ -0,0 +1,148 @@
+#include "PixelKernels.h"
+#include <immintrin.h>
+
+// Compiled with AVX2 enabled and only called after runtime detection. Each
+// kernel handles whole 8/16-pixel blocks and returns how many pixels it
+// wrote; PixelKernels finishes the tail with the scalar code.
+
+namespace {
+
+inline __m256i mixPlaneAvx2(__m256i rgLo, __m256i rgHi, __m256i baLo, __m256i baHi,
+                            __m256i coefRG, __m256i coefBA, __m256i offset)
+{
+    __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(rgLo, coefRG), _mm256_madd_epi16(baLo, coefBA));
+    __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(rgHi, coefRG), _mm256_madd_epi16(baHi, coefBA));
+    lo = _mm256_srai_epi32(_mm256_add_epi32(lo, offset), ColorMatrix::Shift);
+    hi = _mm256_srai_epi32(_mm256_add_epi32(hi, offset), ColorMatrix::Shift);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(255);
+    return _mm256_min_epi16(_mm256_max_epi16(_mm256_packs_epi32(lo, hi), zero), max);
+}
+
+inline __m256 channelAvx2(__m256i pixels, int shift)
+{
+    return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, shift), _mm256_set1_epi32(0xff)));
+}
+
+inline __m256 coverageAvx2(const quint8 *mask, __m256 scale)
+{
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), scale);
+}
+
+inline __m256i roundAvx2(__m256 v)
+{
+    return _mm256_cvttps_epi32(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+}
+
+} // namespace
+
+int addChannelsAvx2(const QRgb *src, QRgb *dst, int count, quint32 add, quint32 sub)
+{
+    const __m256i vadd = _mm256_set1_epi32(static_cast<int>(add));
+    const __m256i vsub = _mm256_set1_epi32(static_cast<int>(sub));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        v = _mm256_subs_epu8(_mm256_adds_epu8(v, vadd), vsub);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+    return i;
+}
+
+int invertAvx2(const QRgb *src, QRgb *dst, int count)
+{
+    const __m256i mask = _mm256_set1_epi32(0x00ffffff);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(v, mask));
+    }
+    return i;
+}
+
+int mixChannelsAvx2(const QRgb *src, QRgb *dst, int count, const ColorMatrix &matrix)
+{
+    __m256i coefRG[4], coefBA[4], offset[4];
+    for (int c = 0; c < 4; ++c) {
+        quint32 rg = quint32(quint16(matrix.at(c, 0))) | (quint32(quint16(matrix.at(c, 1))) << 16);
+        quint32 ba = quint32(quint16(matrix.at(c, 2))) | (quint32(quint16(matrix.at(c, 3))) << 16);
+        coefRG[c] = _mm256_set1_epi32(static_cast<int>(rg));
+        coefBA[c] = _mm256_set1_epi32(static_cast<int>(ba));
+        offset[c] = _mm256_set1_epi32(matrix.at(c, 4) + ColorMatrix::One / 2);
+    }
+    const bool keepAlpha = matrix.isAlphaPreserving();
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+        __m256i b = _mm256_packs_epi32(_mm256_and_si256(p0, byteMask), _mm256_and_si256(p1, byteMask));
+        __m256i g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), byteMask),
+                                       _mm256_and_si256(_mm256_srli_epi32(p1, 8), byteMask));
+        __m256i r = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), byteMask),
+                                       _mm256_and_si256(_mm256_srli_epi32(p1, 16), byteMask));
+        __m256i a = _mm256_packs_epi32(_mm256_srli_epi32(p0, 24), _mm256_srli_epi32(p1, 24));
+
+        __m256i rgLo = _mm256_unpacklo_epi16(r, g);
+        __m256i rgHi = _mm256_unpackhi_epi16(r, g);
+        __m256i baLo = _mm256_unpacklo_epi16(b, a);
+        __m256i baHi = _mm256_unpackhi_epi16(b, a);
+
+        __m256i outR = mixPlaneAvx2(rgLo, rgHi, baLo, baHi, coefRG[0], coefBA[0], offset[0]);
+        __m256i outG = mixPlaneAvx2(rgLo, rgHi, baLo, baHi, coefRG[1], coefBA[1], offset[1]);
+        __m256i outB = mixPlaneAvx2(rgLo, rgHi, baLo, baHi, coefRG[2], coefBA[2], offset[2]);
+        __m256i outA = keepAlpha ? a : mixPlaneAvx2(rgLo, rgHi, baLo, baHi, coefRG[3], coefBA[3], offset[3]);
+
+        // packs/unpack work per 128-bit lane; the pack above and the unpack
+        // below permute pixels the same way, so the output lands in order.
+        __m256i bg = _mm256_or_si256(outB, _mm256_slli_epi16(outG, 8));
+        __m256i ra = _mm256_or_si256(outR, _mm256_slli_epi16(outA, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_unpacklo_epi16(bg, ra));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), _mm256_unpackhi_epi16(bg, ra));
+    }
+    return i;
+}
+
+int blendMaskAvx2(QRgb *dst, const quint8 *mask, int count, QRgb color, float coverageScale)
+{
+    const __m256 scale = _mm256_set1_ps(coverageScale);
+    const __m256 cr = _mm256_set1_ps(float(qRed(color)));
+    const __m256 cg = _mm256_set1_ps(float(qGreen(color)));
+    const __m256 cb = _mm256_set1_ps(float(qBlue(color)));
+    const __m256 ca = _mm256_set1_ps(255.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256 s = coverageAvx2(mask + i, scale);
+        __m256 keep = _mm256_sub_ps(one, s);
+        __m256i r = roundAvx2(_mm256_add_ps(_mm256_mul_ps(channelAvx2(p, 16), keep), _mm256_mul_ps(cr, s)));
+        __m256i g = roundAvx2(_mm256_add_ps(_mm256_mul_ps(channelAvx2(p, 8), keep), _mm256_mul_ps(cg, s)));
+        __m256i b = roundAvx2(_mm256_add_ps(_mm256_mul_ps(channelAvx2(p, 0), keep), _mm256_mul_ps(cb, s)));
+        __m256i a = roundAvx2(_mm256_add_ps(_mm256_mul_ps(channelAvx2(p, 24), keep), _mm256_mul_ps(ca, s)));
+        __m256i out = _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(g, 8)),
+                                      _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(a, 24)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), out);
+    }
+    return i;
+}
+
+int eraseMaskAvx2(QRgb *dst, const quint8 *mask, int count, float coverageScale)
+{
+    const __m256 scale = _mm256_set1_ps(coverageScale);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256 keep = _mm256_sub_ps(one, coverageAvx2(mask + i, scale));
+        __m256i r = roundAvx2(_mm256_mul_ps(channelAvx2(p, 16), keep));
+        __m256i g = roundAvx2(_mm256_mul_ps(channelAvx2(p, 8), keep));
+        __m256i b = roundAvx2(_mm256_mul_ps(channelAvx2(p, 0), keep));
+        __m256i a = roundAvx2(_mm256_mul_ps(channelAvx2(p, 24), keep));
+        __m256i out = _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(g, 8)),
+                                      _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(a, 24)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), out);
+    }
+    return i;
+}
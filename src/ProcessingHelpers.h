@@ -0,0 +1,31 @@
+#ifndef PROCESSINGHELPERS_H
+#define PROCESSINGHELPERS_H
+
+#include <QImage>
+#include <QtGlobal>
+#include "ImageProcessor.h"
+#include "ScratchPool.h"
+
+// Shared by the filter implementations, so every one of them rounds,
+// clamps and allocates its output the same way.
+namespace ProcessingHelpers {
+
+// Rounds a filtered channel value to the nearest byte, saturating.
+inline uchar toByte(float v)
+{
+    return static_cast<uchar>(qBound(0, static_cast<int>(v + 0.5f), 255));
+}
+
+// Reuses result when it already owns a matching buffer, otherwise swaps in
+// one from the scratch pool. A result that shares pixels with the source is
+// never written in place.
+inline void prepareResult(const QSize &size, QImage &result)
+{
+    if (result.size() == size && result.format() == ImageProcessor::WorkingFormat && result.isDetached()) return;
+    ScratchPool::release(result);
+    result = ScratchPool::acquire(size, ImageProcessor::WorkingFormat);
+}
+
+} // namespace ProcessingHelpers
+
+#endif // PROCESSINGHELPERS_H
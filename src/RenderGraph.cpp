@@ -0,0 +1,392 @@
+#include "RenderGraph.h"
+#include "ImageProcessor.h"
+#include "ScratchPool.h"
+#include "TileScheduler.h"
+#include <QPainter>
+#include <QStringList>
+#include <QtMath>
+#include <atomic>
+#include <cstring>
+
+namespace {
+
+quint64 nextRevision()
+{
+    static std::atomic<quint64> counter(0);
+    return ++counter;
+}
+
+} // namespace
+
+RenderNode::RenderNode(const QList<RenderNode*> &inputs)
+    : m_inputs(inputs)
+    , m_cacheKey(0)
+    , m_cached(false)
+    , m_aliased(false)
+    , m_revision(0)
+{
+}
+
+const QImage &RenderNode::output()
+{
+    quint64 current = key();
+    if (canPatch(current)) {
+        bool patched = true;
+        if (m_aliased) {
+            // An identity stage only re-reads its input, which has been
+            // patched by now; there is nothing to recompute.
+            evaluate(m_cache);
+        } else if (!m_dirty.isEmpty()) {
+            QRect rect = m_dirty & m_bounds;
+            patched = rect.isEmpty() || evaluateRegion(m_cache, rect);
+        }
+        if (patched) {
+            if (!m_dirty.isEmpty() && !TileScheduler::isCancelled()) {
+                m_dirty = QRect();
+                m_revision = nextRevision();
+            }
+            return m_cache;
+        }
+    }
+    
+    // A pass-through cache shares its input's pixels; let go of it so the
+    // input can reuse its buffer in place.
+    if (!m_cache.isDetached()) m_cache = QImage();
+    evaluate(m_cache);
+    // Identity stages hand back their input's image. Keep sharing it rather
+    // than copying: it costs no memory, and later region updates re-read it.
+    m_aliased = sharesInput();
+    m_bounds = m_cache.rect();
+    m_cacheKey = current;
+    m_cached = !TileScheduler::isCancelled();
+    if (m_cached) {
+        m_dirty = QRect();
+        m_revision = nextRevision();
+    }
+    return m_cache;
+}
+
+quint64 RenderNode::key() const
+{
+    quint64 seed = parameterHash();
+    for (const RenderNode *input : m_inputs) seed = combine(seed, input->key());
+    return seed;
+}
+
+void RenderNode::release()
+{
+    ScratchPool::release(m_cache);
+    m_cached = false;
+}
+
+void RenderNode::releaseAlias()
+{
+    if (m_aliased) m_cache = QImage();
+}
+
+QRect RenderNode::markDirty(const QRect &inputRect)
+{
+    const int h = halo();
+    const QRect stale = inputRect.adjusted(-h, -h, h, h);
+    m_dirty |= stale;
+    return stale;
+}
+
+bool RenderNode::pendingRegion(QRect *region) const
+{
+    if (!canPatch(key())) return false;
+    *region = m_dirty & m_bounds;
+    return true;
+}
+
+bool RenderNode::evaluateRegion(QImage &result, const QRect &rect)
+{
+    Q_UNUSED(result);
+    Q_UNUSED(rect);
+    return false;
+}
+
+bool RenderNode::canPatch(quint64 current) const
+{
+    return m_cached && current == m_cacheKey && (m_aliased || m_cache.isDetached());
+}
+
+bool RenderNode::sharesInput() const
+{
+    if (m_cache.isNull()) return false;
+    for (const RenderNode *input : m_inputs) {
+        if (m_cache.constBits() == input->m_cache.constBits()) return true;
+    }
+    return false;
+}
+
+void RenderNode::paste(QImage &target, const QImage &patch, const QPoint &at)
+{
+    const qsizetype rowBytes = qsizetype(patch.width()) * 4;
+    for (int y = 0; y < patch.height(); ++y) {
+        memcpy(target.scanLine(at.y() + y) + qsizetype(at.x()) * 4, patch.constScanLine(y), rowBytes);
+    }
+}
+
+quint64 RenderNode::combine(quint64 seed, quint64 value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+SourceNode::SourceNode(const QImage *image)
+    : m_image(image)
+    , m_revision(0)
+    , m_scale(1.0)
+{
+}
+
+quint64 SourceNode::parameterHash() const
+{
+    return combine(m_revision, static_cast<quint64>(qRound(m_scale * 10000)));
+}
+
+void SourceNode::evaluate(QImage &result)
+{
+    if (m_scale >= 1.0 || m_image->isNull()) {
+        result = *m_image;
+        return;
+    }
+    // The smooth scale can't stop halfway; don't start it for a render
+    // that has already been superseded.
+    if (TileScheduler::isCancelled()) {
+        result = QImage();
+        return;
+    }
+    int w = qMax(1, qRound(m_image->width() * m_scale));
+    int h = qMax(1, qRound(m_image->height() * m_scale));
+    result = m_image->scaled(w, h, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+AdjustmentNode::AdjustmentNode(RenderNode *source)
+    : RenderNode({source})
+{
+}
+
+quint64 AdjustmentNode::parameterHash() const
+{
+    quint64 seed = combine(0, static_cast<quint64>(m_settings.brightness));
+    seed = combine(seed, static_cast<quint64>(m_settings.contrast));
+    return combine(seed, static_cast<quint64>(m_settings.saturation));
+}
+
+void AdjustmentNode::evaluate(QImage &result)
+{
+    const AdjustmentSettings &a = m_settings;
+    ImageProcessor::applyAdjustments(m_inputs[0]->output(), result, a.brightness, a.contrast, a.saturation);
+}
+
+bool AdjustmentNode::evaluateRegion(QImage &result, const QRect &rect)
+{
+    const AdjustmentSettings &a = m_settings;
+    QImage patch;
+    ImageProcessor::applyAdjustments(m_inputs[0]->output().copy(rect), patch, a.brightness, a.contrast, a.saturation);
+    paste(result, patch, rect.topLeft());
+    return true;
+}
+
+FilterNode::FilterNode(SourceNode *source, AdjustmentNode *adjustments)
+    : RenderNode({source, adjustments})
+    , m_source(source)
+    , m_adjustments(adjustments)
+{
+}
+
+quint64 FilterNode::parameterHash() const
+{
+    quint64 seed = combine(0, qHash(m_settings.name));
+    seed = combine(seed, static_cast<quint64>(m_settings.intensity));
+    seed = combine(seed, static_cast<quint64>(m_settings.radius));
+    seed = combine(seed, static_cast<quint64>(m_settings.threshold));
+    return combine(seed, static_cast<quint64>(m_settings.angle));
+}
+
+bool FilterNode::isPassThrough() const
+{
+    static const QStringList neighborhood = {"blur", "sharpen", "emboss", "gaussian", "lens", "motion", "median", "unsharp"};
+    ColorMatrix matrix;
+    return !neighborhood.contains(m_settings.name)
+        && !ImageProcessor::filterColorMatrix(m_settings.name, m_settings.intensity, matrix);
+}
+
+void FilterNode::evaluate(QImage &result)
+{
+    const FilterSettings &f = m_settings;
+    ColorMatrix matrix;
+    if (ImageProcessor::filterColorMatrix(f.name, f.intensity, matrix)) {
+        const AdjustmentSettings &a = m_adjustments->settings();
+        ImageProcessor::applyAdjustments(m_inputs[0]->output(), result, a.brightness, a.contrast, a.saturation, matrix);
+        return;
+    }
+    applyNeighborhood(m_adjustments->output(), result);
+}
+
+int FilterNode::halo() const
+{
+    const FilterSettings &f = m_settings;
+    const double scale = m_source->scale();
+    if (f.name == "blur") return scaled(f.intensity / 20);
+    if (f.name == "sharpen" || f.name == "emboss") return 1;
+    if (f.name == "gaussian" || f.name == "unsharp") return qCeil(4 * f.radius * scale);
+    if (f.name == "lens" || f.name == "median") return scaled(f.radius);
+    if (f.name == "motion") return scaled(f.radius * 2 + 1) / 2 + 1;
+    return 0;
+}
+
+bool FilterNode::evaluateRegion(QImage &result, const QRect &rect)
+{
+    const FilterSettings &f = m_settings;
+    ColorMatrix matrix;
+    QImage patch;
+    if (ImageProcessor::filterColorMatrix(f.name, f.intensity, matrix)) {
+        const AdjustmentSettings &a = m_adjustments->settings();
+        ImageProcessor::applyAdjustments(m_inputs[0]->output().copy(rect), patch, a.brightness, a.contrast, a.saturation, matrix);
+        paste(result, patch, rect.topLeft());
+        return true;
+    }
+    
+    // Filter a copy padded by the halo; the padding absorbs the border
+    // handling at the cut, so the pixels inside `rect` come out as if the
+    // whole image had been filtered.
+    const QImage &base = m_adjustments->output();
+    const int h = halo();
+    const QRect padded = rect.adjusted(-h, -h, h, h) & base.rect();
+    applyNeighborhood(base.copy(padded), patch);
+    paste(result, patch.copy(rect.translated(-padded.topLeft())), rect.topLeft());
+    return true;
+}
+
+int FilterNode::scaled(int radius) const
+{
+    // Radii are in document pixels; shrink them with a preview proxy so the
+    // effect looks the same on screen.
+    return radius > 0 ? qMax(1, qRound(radius * m_source->scale())) : 0;
+}
+
+void FilterNode::applyNeighborhood(const QImage &base, QImage &result) const
+{
+    const FilterSettings &f = m_settings;
+    const double scale = m_source->scale();
+    if (f.name == "blur") ImageProcessor::applyBlur(base, result, scaled(f.intensity / 20));
+    else if (f.name == "sharpen") ImageProcessor::applySharpen(base, result, f.intensity);
+    else if (f.name == "emboss") ImageProcessor::applyEmboss(base, result, f.intensity);
+    else if (f.name == "gaussian") ImageProcessor::applyGaussianBlur(base, result, f.radius * scale);
+    else if (f.name == "lens") ImageProcessor::applyLensBlur(base, result, scaled(f.radius));
+    else if (f.name == "motion") ImageProcessor::applyMotionBlur(base, result, scaled(f.radius * 2 + 1), f.angle);
+    else if (f.name == "median") ImageProcessor::applyMedian(base, result, scaled(f.radius));
+    else if (f.name == "unsharp") ImageProcessor::applyUnsharpMask(base, result, f.radius * scale, f.intensity * 2, f.threshold);
+    else result = base;
+}
+
+OverlayNode::OverlayNode(RenderNode *filtered)
+    : RenderNode({filtered})
+{
+}
+
+quint64 OverlayNode::parameterHash() const
+{
+    quint64 seed = combine(0, static_cast<quint64>(m_items.size()));
+    for (const TextItem &t : m_items) {
+        seed = combine(seed, qHash(t.text));
+        seed = combine(seed, qHash(t.font.toString()));
+        seed = combine(seed, t.color.rgba());
+        seed = combine(seed, (static_cast<quint64>(quint32(t.boundingRect.x())) << 32) | quint32(t.boundingRect.y()));
+        seed = combine(seed, (static_cast<quint64>(quint32(t.boundingRect.width())) << 32) | quint32(t.boundingRect.height()));
+    }
+    return seed;
+}
+
+void OverlayNode::evaluate(QImage &result)
+{
+    const QImage &filtered = m_inputs[0]->output();
+    if (m_items.isEmpty() || filtered.isNull()) {
+        result = filtered;
+        return;
+    }
+    
+    result = filtered.copy();
+    QPainter p(&result);
+    for (const TextItem &t : m_items) {
+        p.setFont(t.font);
+        p.setPen(t.color);
+        p.drawText(t.boundingRect, Qt::AlignLeft | Qt::AlignTop, t.text);
+    }
+    p.end();
+}
+
+RenderGraph::RenderGraph(const QImage *document)
+    : m_document(document)
+    , m_source(document)
+    , m_adjustments(&m_source)
+    , m_filter(&m_source, &m_adjustments)
+    , m_overlay(&m_filter)
+{
+}
+
+void RenderGraph::invalidateSource()
+{
+    m_source.touch();
+    releaseAll();
+}
+
+void RenderGraph::invalidateRegion(const QRect &rect)
+{
+    if (m_source.scale() < 1.0) {
+        invalidateSource();
+        return;
+    }
+    // The source aliases the document, and so may any pass-through stage
+    // after it; drop them before the edit writes. Re-reading them later is
+    // free and keeps the same key.
+    m_source.release();
+    m_adjustments.releaseAlias();
+    m_filter.releaseAlias();
+    m_overlay.releaseAlias();
+    m_source.markDirty(rect);
+    m_overlay.markDirty(m_filter.markDirty(m_adjustments.markDirty(rect)));
+}
+
+void RenderGraph::setAdjustments(const AdjustmentSettings &settings)
+{
+    m_adjustments.setSettings(settings);
+}
+
+void RenderGraph::setFilter(const FilterSettings &settings)
+{
+    m_filter.setSettings(settings);
+}
+
+void RenderGraph::setTextItems(const QList<TextItem> &items)
+{
+    m_overlay.setItems(items);
+}
+
+void RenderGraph::setPreviewScale(double scale)
+{
+    m_source.setScale(qBound(0.01, scale, 1.0));
+}
+
+bool RenderGraph::displayIsDocument()
+{
+    const QImage &image = display();
+    return !image.isNull() && image.constBits() == m_document->constBits();
+}
+
+RenderNode *RenderGraph::displayNode()
+{
+    // Without a filter the adjusted image is the display image; skipping
+    // the filter stage avoids keeping a second copy of it up to date.
+    return m_filter.isPassThrough() ? static_cast<RenderNode*>(&m_adjustments) : &m_filter;
+}
+
+void RenderGraph::releaseAll()
+{
+    m_overlay.release();
+    m_filter.release();
+    m_adjustments.release();
+    m_source.release();
+}
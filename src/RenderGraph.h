@@ -0,0 +1,220 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <QImage>
+#include <QList>
+#include <QString>
+#include <QFont>
+#include <QColor>
+#include <QRect>
+
+struct TextItem {
+    QString text;
+    QPoint pos;
+    QFont font;
+    QColor color;
+    QRect boundingRect;
+};
+
+struct AdjustmentSettings {
+    int brightness = 100;
+    int contrast = 100;
+    int saturation = 100;
+};
+
+struct FilterSettings {
+    QString name;
+    int intensity = 100;
+    int radius = 5;
+    int threshold = 0;
+    int angle = 0;
+};
+
+// One stage of the canvas pipeline. A node's key combines its inputs' keys
+// with a hash of its own parameters; output() re-runs evaluate() only when
+// that key differs from the one the cached image was built for, so
+// changing a stage never recomputes anything upstream of it. A graph is not
+// thread-safe; the canvas only touches it with its render lock held.
+//
+// A stage that leaves its input unchanged outputs the input's image itself,
+// so an identity pipeline holds no pixels besides the document.
+//
+// Local edits don't change the key. Instead a dirty rectangle flows down
+// the graph, each node growing it by the distance its output pixels read
+// around their input pixels (halo), and output() patches just that region
+// of the cache in place when the node supports it.
+class RenderNode
+{
+public:
+    virtual ~RenderNode() = default;
+    
+    const QImage &output();
+    quint64 key() const;
+    void release();
+    // Drops the cache if it only shares its input's pixels, without
+    // forgetting what it holds; the next output() re-reads the input.
+    void releaseAlias();
+    // Stamp that changes whenever output() produces different pixels, unique
+    // across nodes.
+    quint64 revision() const { return m_revision; }
+    
+    // Records that `inputRect` of the inputs changed; returns the part of
+    // this node's output that is now stale.
+    QRect markDirty(const QRect &inputRect);
+    
+    // True when the next output() only patches `region` of the previous
+    // output (which may be empty); false when it will be rebuilt.
+    bool pendingRegion(QRect *region) const;
+
+protected:
+    explicit RenderNode(const QList<RenderNode*> &inputs = QList<RenderNode*>());
+    
+    virtual quint64 parameterHash() const = 0;
+    virtual void evaluate(QImage &result) = 0;
+    virtual int halo() const { return 0; }
+    virtual bool evaluateRegion(QImage &result, const QRect &rect);
+    
+    static quint64 combine(quint64 seed, quint64 value);
+    static void paste(QImage &target, const QImage &patch, const QPoint &at);
+    
+    QList<RenderNode*> m_inputs;
+
+private:
+    bool canPatch(quint64 current) const;
+    bool sharesInput() const;
+    
+    QImage m_cache;
+    quint64 m_cacheKey;
+    bool m_cached;
+    // The cache is an input's image, passed through unchanged.
+    bool m_aliased;
+    QRect m_bounds;
+    QRect m_dirty;
+    quint64 m_revision;
+};
+
+// Reads the canvas document in place; touch() is called by the canvas
+// whenever the document changes. Below a scale of 1 it yields a
+// downsampled proxy instead, which every later stage then works on.
+class SourceNode : public RenderNode
+{
+public:
+    explicit SourceNode(const QImage *image);
+    
+    void touch() { ++m_revision; }
+    void setScale(double scale) { m_scale = scale; }
+    double scale() const { return m_scale; }
+
+protected:
+    quint64 parameterHash() const override;
+    void evaluate(QImage &result) override;
+
+private:
+    const QImage *m_image;
+    quint64 m_revision;
+    double m_scale;
+};
+
+class AdjustmentNode : public RenderNode
+{
+public:
+    explicit AdjustmentNode(RenderNode *source);
+    
+    void setSettings(const AdjustmentSettings &settings) { m_settings = settings; }
+    const AdjustmentSettings &settings() const { return m_settings; }
+
+protected:
+    quint64 parameterHash() const override;
+    void evaluate(QImage &result) override;
+    bool evaluateRegion(QImage &result, const QRect &rect) override;
+
+private:
+    AdjustmentSettings m_settings;
+};
+
+// Neighborhood filters run on the adjusted image. Affine color filters are
+// folded into the adjustment pass instead, straight from the source, so
+// they cost a single pass.
+class FilterNode : public RenderNode
+{
+public:
+    FilterNode(SourceNode *source, AdjustmentNode *adjustments);
+    
+    void setSettings(const FilterSettings &settings) { m_settings = settings; }
+    const FilterSettings &settings() const { return m_settings; }
+    bool isPassThrough() const;
+
+protected:
+    quint64 parameterHash() const override;
+    void evaluate(QImage &result) override;
+    int halo() const override;
+    bool evaluateRegion(QImage &result, const QRect &rect) override;
+
+private:
+    void applyNeighborhood(const QImage &base, QImage &result) const;
+    int scaled(int radius) const;
+    
+    SourceNode *m_source;
+    AdjustmentNode *m_adjustments;
+    FilterSettings m_settings;
+};
+
+// The filtered image with text items rasterized on top, for export.
+class OverlayNode : public RenderNode
+{
+public:
+    explicit OverlayNode(RenderNode *filtered);
+    
+    void setItems(const QList<TextItem> &items) { m_items = items; }
+
+protected:
+    quint64 parameterHash() const override;
+    void evaluate(QImage &result) override;
+
+private:
+    QList<TextItem> m_items;
+};
+
+class RenderGraph
+{
+public:
+    explicit RenderGraph(const QImage *document);
+    
+    // Call before the document is modified: the cached stages may share
+    // its pixels, and dropping them first avoids a detach copy on write.
+    void invalidateSource();
+    // Same for an edit confined to `rect`; downstream caches stay and only
+    // the affected region is recomputed.
+    void invalidateRegion(const QRect &rect);
+    
+    void setAdjustments(const AdjustmentSettings &settings);
+    const AdjustmentSettings &adjustments() const { return m_adjustments.settings(); }
+    void setFilter(const FilterSettings &settings);
+    const FilterSettings &filter() const { return m_filter.settings(); }
+    void setTextItems(const QList<TextItem> &items);
+    
+    // Renders at a fraction of full resolution (pixel radii scale with it)
+    // until reset to 1; used for interactive previews.
+    void setPreviewScale(double scale);
+    double previewScale() const { return m_source.scale(); }
+    
+    const QImage &display() { return displayNode()->output(); }
+    bool pendingDisplayRegion(QRect *region) { return displayNode()->pendingRegion(region); }
+    quint64 displayRevision() { return displayNode()->revision(); }
+    // True when no stage changes any pixel, so the display image is the
+    // document itself.
+    bool displayIsDocument();
+    const QImage &composite() { return m_overlay.output(); }
+
+private:
+    RenderNode *displayNode();
+    void releaseAll();
+    
+    const QImage *m_document;
+    SourceNode m_source;
+    AdjustmentNode m_adjustments;
+    FilterNode m_filter;
+    OverlayNode m_overlay;
+};
+
+#endif // RENDERGRAPH_H
@@ -0,0 +1,85 @@
+#include "ScratchPool.h"
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace {
+
+struct Pool
+{
+    QMutex mutex;
+    QList<QImage> images;
+    qint64 bytes = 0;
+    qint64 capacity = 512ll * 1024 * 1024;
+    
+    void trim()
+    {
+        while (bytes > capacity && !images.isEmpty()) {
+            bytes -= images.first().sizeInBytes();
+            images.removeFirst();
+        }
+    }
+};
+
+Pool &pool()
+{
+    static Pool instance;
+    return instance;
+}
+
+} // namespace
+
+QImage ScratchPool::acquire(const QSize &size, QImage::Format format)
+{
+    Pool &p = pool();
+    {
+        QMutexLocker locker(&p.mutex);
+        for (int i = p.images.size() - 1; i >= 0; --i) {
+            const QImage &candidate = p.images.at(i);
+            if (candidate.size() == size && candidate.format() == format) {
+                QImage image = p.images.takeAt(i);
+                p.bytes -= image.sizeInBytes();
+                return image;
+            }
+        }
+    }
+    return QImage(size, format);
+}
+
+void ScratchPool::release(QImage &image)
+{
+    if (image.isNull() || !image.isDetached()) {
+        image = QImage();
+        return;
+    }
+    
+    Pool &p = pool();
+    QMutexLocker locker(&p.mutex);
+    p.bytes += image.sizeInBytes();
+    p.images.append(image);
+    image = QImage();
+    p.trim();
+}
+
+void ScratchPool::setCapacity(qint64 bytes)
+{
+    Pool &p = pool();
+    QMutexLocker locker(&p.mutex);
+    p.capacity = qMax<qint64>(0, bytes);
+    p.trim();
+}
+
+qint64 ScratchPool::capacity()
+{
+    Pool &p = pool();
+    QMutexLocker locker(&p.mutex);
+    return p.capacity;
+}
+
+void ScratchPool::clear()
+{
+    Pool &p = pool();
+    QMutexLocker locker(&p.mutex);
+    p.images.clear();
+    p.bytes = 0;
+}
@@ -0,0 +1,21 @@
+#ifndef SCRATCHPOOL_H
+#define SCRATCHPOOL_H
+
+#include <QImage>
+
+// Recycles full-size image buffers so repeated filter passes (slider drags,
+// brush strokes) stop hitting the allocator. Buffers are matched by size and
+// format; release() only keeps an image when it is the sole owner of its
+// pixels, so shared data is never handed out twice. Thread-safe.
+class ScratchPool
+{
+public:
+    static QImage acquire(const QSize &size, QImage::Format format);
+    static void release(QImage &image);
+    
+    static void setCapacity(qint64 bytes);
+    static qint64 capacity();
+    static void clear();
+};
+
+#endif // SCRATCHPOOL_H
@@ -0,0 +1,96 @@
+#include "TileScheduler.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QAtomicInt>
+
+namespace {
+
+const int BandsPerThread = 4;
+
+thread_local bool insideBand = false;
+thread_local const std::function<bool()> *cancelTest = nullptr;
+
+QThreadPool *pool()
+{
+    static QThreadPool instance;
+    return &instance;
+}
+
+int &configuredThreads()
+{
+    static int count = 0;
+    return count;
+}
+
+} // namespace
+
+int TileScheduler::threadCount()
+{
+    int count = configuredThreads();
+    return count > 0 ? count : qMax(1, QThread::idealThreadCount());
+}
+
+void TileScheduler::setThreadCount(int count)
+{
+    configuredThreads() = qMax(0, count);
+    pool()->setMaxThreadCount(qMax(1, threadCount() - 1));
+}
+
+void TileScheduler::run(int rows, const std::function<void(int y0, int y1)> &task, int minBandRows)
+{
+    if (rows <= 0) return;
+    
+    const int threads = threadCount();
+    const int bandRows = qMax(qMax(1, minBandRows), (rows + threads * BandsPerThread - 1) / (threads * BandsPerThread));
+    const int bands = (rows + bandRows - 1) / bandRows;
+    if (bands == 1 || insideBand) {
+        task(0, rows);
+        return;
+    }
+    
+    // Single-threaded runs still go band by band so they can be cancelled.
+    const std::function<bool()> *test = cancelTest;
+    QAtomicInt next(0);
+    auto work = [&]() {
+        const bool nested = insideBand;
+        const std::function<bool()> *outerTest = cancelTest;
+        insideBand = true;
+        cancelTest = test;
+        for (int band = next.fetchAndAddRelaxed(1); band < bands; band = next.fetchAndAddRelaxed(1)) {
+            if (test && (*test)()) break;
+            const int y0 = band * bandRows;
+            task(y0, qMin(rows, y0 + bandRows));
+        }
+        insideBand = nested;
+        cancelTest = outerTest;
+    };
+    
+    const int helpers = qMin(threads, bands) - 1;
+    QSemaphore finished;
+    for (int i = 0; i < helpers; ++i) {
+        pool()->start([&]() {
+            work();
+            finished.release();
+        });
+    }
+    work();
+    finished.acquire(helpers);
+}
+
+TileScheduler::CancelScope::CancelScope(const std::function<bool()> &test)
+    : m_test(test)
+    , m_previous(cancelTest)
+{
+    cancelTest = &m_test;
+}
+
+TileScheduler::CancelScope::~CancelScope()
+{
+    cancelTest = m_previous;
+}
+
+bool TileScheduler::isCancelled()
+{
+    return cancelTest && (*cancelTest)();
+}
@@ -0,0 +1,40 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <functional>
+
+// Splits a run of image rows into bands and processes them on a private
+// thread pool; the calling thread works on bands too. Bands are handed out
+// dynamically, so a slow band doesn't stall the rest. A task must only write
+// rows in [y0, y1) and may read anything it doesn't write, which is how
+// neighborhood filters get their halo rows for free. Calls made from inside
+// a band run serially on that worker.
+class TileScheduler
+{
+public:
+    static int threadCount();
+    static void setThreadCount(int count);
+
+    static void run(int rows, const std::function<void(int y0, int y1)> &task, int minBandRows = 16);
+    
+    // While a scope is alive, run() calls made on this thread stop handing
+    // out bands as soon as the test returns true. A cancelled run leaves
+    // its output incomplete; check isCancelled() and discard it.
+    class CancelScope
+    {
+    public:
+        explicit CancelScope(const std::function<bool()> &test);
+        ~CancelScope();
+        
+        CancelScope(const CancelScope &) = delete;
+        CancelScope &operator=(const CancelScope &) = delete;
+    
+    private:
+        std::function<bool()> m_test;
+        const std::function<bool()> *m_previous;
+    };
+    
+    static bool isCancelled();
+};
+
+#endif // TILESCHEDULER_H
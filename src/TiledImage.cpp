@@ -0,0 +1,153 @@
+#include "TiledImage.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+void fillTile(const UndoTile &tile, QImage &image, const QPoint &at)
+{
+    const QRgb color = tile.color();
+    for (int y = 0; y < tile.size().height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(at.y() + y)) + at.x();
+        std::fill(line, line + tile.size().width(), color);
+    }
+}
+
+void copyTile(const QImage &pixels, QImage &image, const QPoint &at)
+{
+    const int bytes = pixels.width() * 4;
+    for (int y = 0; y < pixels.height(); ++y) {
+        memcpy(image.scanLine(at.y() + y) + at.x() * 4, pixels.constScanLine(y), bytes);
+    }
+}
+
+// True when every pixel of `rect` in `image` equals *color, which is set
+// to the first one. Photographic tiles fail within the first few pixels.
+bool isSolid(const QImage &image, const QRect &rect, QRgb *color)
+{
+    *color = reinterpret_cast<const QRgb*>(image.constScanLine(rect.top()))[rect.left()];
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y)) + rect.left();
+        for (int x = 0; x < rect.width(); ++x) {
+            if (line[x] != *color) return false;
+        }
+    }
+    return true;
+}
+
+bool sameTile(const QSharedPointer<UndoTile> &a, const QSharedPointer<UndoTile> &b)
+{
+    if (a == b) return true;
+    return a && b && a->isSolid() && b->isSolid() && a->color() == b->color() && a->size() == b->size();
+}
+
+} // namespace
+
+TiledImage::TiledImage()
+    : m_format(QImage::Format_Invalid)
+    , m_columns(0)
+    , m_rows(0)
+{
+}
+
+QRect TiledImage::tileRect(int index) const
+{
+    const QRect rect((index % m_columns) * TileSize, (index / m_columns) * TileSize, TileSize, TileSize);
+    return rect & QRect(QPoint(0, 0), m_size);
+}
+
+void TiledImage::markStale(const QRect &rect)
+{
+    if (rect.isNull()) {
+        m_stale.fill(true);
+        return;
+    }
+    const QRect area = rect & QRect(QPoint(0, 0), m_size);
+    if (area.isEmpty()) return;
+    for (int ty = area.top() / TileSize; ty <= area.bottom() / TileSize; ++ty) {
+        for (int tx = area.left() / TileSize; tx <= area.right() / TileSize; ++tx) m_stale[ty * m_columns + tx] = true;
+    }
+}
+
+void TiledImage::sync(const QImage &image)
+{
+    if (image.size() != m_size || image.format() != m_format) {
+        m_size = image.size();
+        m_format = image.format();
+        m_columns = (m_size.width() + TileSize - 1) / TileSize;
+        m_rows = (m_size.height() + TileSize - 1) / TileSize;
+        m_tiles = QVector<QSharedPointer<UndoTile>>(m_columns * m_rows);
+        m_stale = QVector<bool>(m_columns * m_rows, true);
+    }
+    for (int i = 0; i < m_tiles.size(); ++i) {
+        if (!m_stale[i]) continue;
+        // A fresh tile rather than writing into the old one, which earlier
+        // states may still share. Blank areas keep just their colour.
+        const QRect rect = tileRect(i);
+        QRgb color;
+        if (isSolid(image, rect, &color)) m_tiles[i] = UndoStore::storeSolid(rect.size(), m_format, color);
+        else m_tiles[i] = UndoStore::store(image.copy(rect));
+        m_stale[i] = false;
+    }
+}
+
+QRect TiledImage::changedFrom(const TiledImage &other) const
+{
+    QRect changed;
+    for (int i = 0; i < m_tiles.size() && i < other.m_tiles.size(); ++i) {
+        if (!sameTile(m_tiles[i], other.m_tiles[i])) changed |= tileRect(i);
+    }
+    return changed;
+}
+
+bool TiledImage::restoreInto(QImage &image, const TiledImage &current) const
+{
+    if (isNull()) {
+        image = QImage();
+        return true;
+    }
+    if (m_size != current.m_size || m_format != current.m_format || image.size() != m_size) {
+        const QImage restored = toImage();
+        if (restored.isNull()) return false;
+        image = restored;
+        return true;
+    }
+    
+    // Read every tile before writing any, so a failed read leaves the
+    // image as it was rather than half restored.
+    QVector<int> changed;
+    QVector<QImage> pixels;
+    for (int i = 0; i < m_tiles.size(); ++i) {
+        if (sameTile(m_tiles[i], current.m_tiles[i])) continue;
+        changed.append(i);
+        if (m_tiles[i]->isSolid()) {
+            pixels.append(QImage());
+            continue;
+        }
+        pixels.append(m_tiles[i]->pixels());
+        if (pixels.last().isNull()) return false;
+    }
+    for (int n = 0; n < changed.size(); ++n) {
+        const int i = changed[n];
+        if (m_tiles[i]->isSolid()) fillTile(*m_tiles[i], image, tileRect(i).topLeft());
+        else copyTile(pixels[n], image, tileRect(i).topLeft());
+    }
+    return true;
+}
+
+QImage TiledImage::toImage() const
+{
+    if (isNull()) return QImage();
+    QImage image(m_size, m_format);
+    if (image.isNull()) return image;
+    for (int i = 0; i < m_tiles.size(); ++i) {
+        if (m_tiles[i]->isSolid()) {
+            fillTile(*m_tiles[i], image, tileRect(i).topLeft());
+            continue;
+        }
+        const QImage pixels = m_tiles[i]->pixels();
+        if (pixels.isNull()) return QImage();
+        copyTile(pixels, image, tileRect(i).topLeft());
+    }
+    return image;
+}
@@ -0,0 +1,57 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include <QSharedPointer>
+#include "UndoStore.h"
+
+// An image held as a grid of shared tiles. Copying a TiledImage copies no
+// pixels, and two copies only diverge in the tiles that get refreshed, so
+// a history of states that differ in a few places costs little more than
+// one image. Tile pixels live in UndoStore, which may compress or spill
+// them; tiles of a single colour, such as the untouched parts of a new
+// canvas, are kept as that colour alone.
+//
+// It mirrors a flat working image: markStale() records which areas of that
+// image changed, and sync() re-copies just the tiles covering them.
+class TiledImage
+{
+public:
+    static const int TileSize = 256;
+    
+    TiledImage();
+    
+    bool isNull() const { return m_size.isEmpty(); }
+    QSize size() const { return m_size; }
+    
+    // Marks `rect` of the mirrored image as changed; a null rect marks all.
+    void markStale(const QRect &rect = QRect());
+    // Refreshes the stale tiles from `image`. A different size or format
+    // rebuilds every tile.
+    void sync(const QImage &image);
+    
+    // Bounding rect of the tiles that differ from `other`, which must have
+    // the same size; empty when every tile is shared.
+    QRect changedFrom(const TiledImage &other) const;
+    // Writes into `image` the tiles of this state that aren't shared with
+    // `current`, which must be in sync with `image`. When the sizes differ,
+    // `image` is rebuilt from scratch. Returns false, leaving `image`
+    // untouched, if any tile can't be read back.
+    bool restoreInto(QImage &image, const TiledImage &current) const;
+    // Null if any tile can't be read back.
+    QImage toImage() const;
+
+private:
+    QRect tileRect(int index) const;
+    
+    QSize m_size;
+    QImage::Format m_format;
+    int m_columns;
+    int m_rows;
+    QVector<QSharedPointer<UndoTile>> m_tiles;
+    QVector<bool> m_stale;
+};
+
+#endif // TILEDIMAGE_H
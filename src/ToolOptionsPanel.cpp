@@ -74,6 +74,33 @@ void ToolOptionsPanel::setupUi()
     
     layout->addWidget(stack);
     
+    // Dab shape and flow are shared by the brush and the eraser.
+    m_dabOptions = new QWidget();
+    QVBoxLayout *dabLayout = new QVBoxLayout(m_dabOptions);
+    auto addDabSlider = [this, dabLayout](const QString &label, QSlider *&slider, int minVal, int maxVal, int defVal,
+                                          void (ToolOptionsPanel::*signal)(int)) {
+        dabLayout->addWidget(new QLabel(label));
+        QHBoxLayout *row = new QHBoxLayout();
+        slider = new QSlider(Qt::Horizontal);
+        slider->setRange(minVal, maxVal);
+        slider->setValue(defVal);
+        row->addWidget(slider, 1);
+        QSpinBox *spin = new QSpinBox();
+        spin->setRange(minVal, maxVal);
+        spin->setValue(defVal);
+        spin->setSuffix("%");
+        row->addWidget(spin);
+        dabLayout->addLayout(row);
+        connect(slider, &QSlider::valueChanged, spin, &QSpinBox::setValue);
+        connect(spin, QOverload<int>::of(&QSpinBox::valueChanged), slider, &QSlider::setValue);
+        connect(slider, &QSlider::valueChanged, this, signal);
+    };
+    addDabSlider("硬度:", m_hardnessSlider, 0, 100, 100, &ToolOptionsPanel::brushHardnessChanged);
+    addDabSlider("间距:", m_spacingSlider, 1, 200, 25, &ToolOptionsPanel::brushSpacingChanged);
+    addDabSlider("流量:", m_flowSlider, 1, 100, 100, &ToolOptionsPanel::brushFlowChanged);
+    layout->addWidget(m_dabOptions);
+    layout->addStretch();
+    
     connect(m_brushSizeSlider, &QSlider::valueChanged, m_brushSizeSpin, &QSpinBox::setValue);
     connect(m_brushSizeSpin, QOverload<int>::of(&QSpinBox::valueChanged), m_brushSizeSlider, &QSlider::setValue);
     connect(m_brushSizeSlider, &QSlider::valueChanged, this, &ToolOptionsPanel::brushSizeChanged);
@@ -90,6 +117,7 @@ void ToolOptionsPanel::setCurrentTool(int toolType)
 {
     if (!m_stack) return;
     
+    m_dabOptions->setVisible(toolType == TOOL_BRUSH || toolType == TOOL_ERASER);
     if (toolType == TOOL_BRUSH) {
         m_stack->setCurrentWidget(m_brushOptions);
     } else if (toolType == TOOL_ERASER) {
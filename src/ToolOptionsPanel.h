@@ -18,6 +18,9 @@ signals:
     void brushSizeChanged(int size);
     void brushColorChanged(const QColor &color);
     void eraserSizeChanged(int size);
+    void brushHardnessChanged(int hardness);
+    void brushSpacingChanged(int spacing);
+    void brushFlowChanged(int flow);
 
 public slots:
     void setCurrentTool(int toolType);
@@ -32,6 +35,10 @@ private:
     QPushButton *m_colorButton;
     QSlider *m_eraserSizeSlider;
     QSpinBox *m_eraserSizeSpin;
+    QWidget *m_dabOptions;
+    QSlider *m_hardnessSlider;
+    QSlider *m_spacingSlider;
+    QSlider *m_flowSlider;
     QStackedWidget *m_stack;
 };
 
@@ -0,0 +1,312 @@
+#include "UndoStore.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <cstring>
+#include <map>
+#include <memory>
+
+namespace {
+
+struct Store
+{
+    Store() { pool.setMaxThreadCount(1); }
+    
+    QMutex mutex;
+    // Keyed by creation order, so begin() is always the oldest tile.
+    std::map<quint64, UndoTile*> rawTiles;
+    std::map<quint64, UndoTile*> packedTiles;
+    // Keyed by file offset, for compaction.
+    std::map<qint64, UndoTile*> spilledTiles;
+    quint64 nextSequence = 0;
+    UndoStore::Usage usage;
+    qint64 memoryBudget = 512ll * 1024 * 1024;
+    qint64 spillThreshold = 1024ll * 1024 * 1024;
+    bool trimQueued = false;
+    // Set once the spill file can't be opened or written; history then
+    // stays in memory and the canvas drops old steps to honour the limit.
+    bool spillFailed = false;
+    
+    // Spills append at fileEnd. Dropped tiles leave holes, which
+    // compaction squeezes out once they outweigh the live bytes; `spilled`
+    // counts the live ones. Owned here so it is removed at exit.
+    std::unique_ptr<QTemporaryFile> file;
+    qint64 fileEnd = 0;
+    qint64 spilled = 0;
+    bool compactable = true;
+    
+    QThreadPool pool;
+    
+    bool overBudget() const
+    {
+        return (usage.raw > memoryBudget && !rawTiles.empty()) || needsSpill() || needsCompaction();
+    }
+    
+    bool needsSpill() const
+    {
+        return !spillFailed && usage.raw + usage.compressed > spillThreshold && !packedTiles.empty();
+    }
+    
+    bool needsCompaction() const
+    {
+        return compactable && fileEnd - spilled > spilled;
+    }
+};
+
+Store &store()
+{
+    static Store instance;
+    return instance;
+}
+
+} // namespace
+
+UndoTile::UndoTile(const QImage &pixels)
+    : m_solid(false)
+    , m_color(0)
+    , m_raw(pixels)
+    , m_fileOffset(-1)
+    , m_fileLength(0)
+    , m_size(pixels.size())
+    , m_format(pixels.format())
+    , m_sequence(0)
+{
+}
+
+UndoTile::UndoTile(const QSize &size, QImage::Format format, QRgb color)
+    : m_solid(true)
+    , m_color(color)
+    , m_fileOffset(-1)
+    , m_fileLength(0)
+    , m_size(size)
+    , m_format(format)
+    , m_sequence(0)
+{
+}
+
+UndoTile::~UndoTile()
+{
+    if (m_solid) return;
+    Store &s = store();
+    {
+        QMutexLocker locker(&s.mutex);
+        if (!m_raw.isNull()) {
+            s.rawTiles.erase(m_sequence);
+            s.usage.raw -= m_raw.sizeInBytes();
+            return;
+        }
+        if (m_fileOffset < 0) {
+            s.packedTiles.erase(m_sequence);
+            s.usage.compressed -= m_packed.size();
+            return;
+        }
+        s.spilledTiles.erase(m_fileOffset);
+        s.spilled -= m_fileLength;
+        if (s.spilled == 0) {
+            s.file->resize(0);
+            s.fileEnd = 0;
+        }
+    }
+    UndoStore::scheduleTrim();
+}
+
+QImage UndoTile::pixels() const
+{
+    if (m_solid) {
+        QImage image(m_size, m_format);
+        image.fill(m_color);
+        return image;
+    }
+    
+    Store &s = store();
+    QByteArray packed;
+    {
+        QMutexLocker locker(&s.mutex);
+        if (!m_raw.isNull()) return m_raw;
+        if (m_fileOffset < 0) {
+            packed = m_packed;
+        } else {
+            if (!s.file->seek(m_fileOffset)) return QImage();
+            packed = s.file->read(m_fileLength);
+            if (packed.size() != m_fileLength) return QImage();
+        }
+    }
+    
+    const QByteArray bytes = qUncompress(packed);
+    QImage image(m_size, m_format);
+    if (image.isNull() || bytes.size() != image.sizeInBytes()) return QImage();
+    memcpy(image.bits(), bytes.constData(), bytes.size());
+    return image;
+}
+
+QSharedPointer<UndoTile> UndoStore::store(const QImage &pixels)
+{
+    QSharedPointer<UndoTile> tile(new UndoTile(pixels));
+    Store &s = ::store();
+    {
+        QMutexLocker locker(&s.mutex);
+        tile->m_sequence = s.nextSequence++;
+        s.rawTiles[tile->m_sequence] = tile.data();
+        s.usage.raw += pixels.sizeInBytes();
+    }
+    scheduleTrim();
+    return tile;
+}
+
+QSharedPointer<UndoTile> UndoStore::storeSolid(const QSize &size, QImage::Format format, QRgb color)
+{
+    return QSharedPointer<UndoTile>(new UndoTile(size, format, color));
+}
+
+void UndoStore::setMemoryBudget(qint64 bytes)
+{
+    {
+        QMutexLocker locker(&::store().mutex);
+        ::store().memoryBudget = qMax<qint64>(0, bytes);
+    }
+    scheduleTrim();
+}
+
+qint64 UndoStore::memoryBudget()
+{
+    QMutexLocker locker(&::store().mutex);
+    return ::store().memoryBudget;
+}
+
+void UndoStore::setSpillThreshold(qint64 bytes)
+{
+    {
+        QMutexLocker locker(&::store().mutex);
+        ::store().spillThreshold = qMax<qint64>(0, bytes);
+    }
+    scheduleTrim();
+}
+
+qint64 UndoStore::spillThreshold()
+{
+    QMutexLocker locker(&::store().mutex);
+    return ::store().spillThreshold;
+}
+
+UndoStore::Usage UndoStore::usage()
+{
+    QMutexLocker locker(&::store().mutex);
+    Usage usage = ::store().usage;
+    // The file's real size, holes included.
+    usage.disk = ::store().fileEnd;
+    usage.spillFailed = ::store().spillFailed;
+    return usage;
+}
+
+bool UndoStore::overLimit()
+{
+    Store &s = ::store();
+    QMutexLocker locker(&s.mutex);
+    return s.spillFailed && s.usage.raw + s.usage.compressed > s.spillThreshold;
+}
+
+void UndoStore::scheduleTrim()
+{
+    Store &s = ::store();
+    QMutexLocker locker(&s.mutex);
+    if (s.trimQueued || !s.overBudget()) return;
+    s.trimQueued = true;
+    s.pool.start([]() { trim(); });
+}
+
+void UndoStore::trim()
+{
+    Store &s = ::store();
+    for (;;) {
+        QMutexLocker locker(&s.mutex);
+        if (!s.overBudget()) {
+            s.trimQueued = false;
+            return;
+        }
+        
+        if (s.usage.raw > s.memoryBudget && !s.rawTiles.empty()) {
+            // Compress outside the lock; the tile may be gone by the time
+            // the result is ready, in which case it is simply dropped.
+            const quint64 sequence = s.rawTiles.begin()->first;
+            const QImage raw = s.rawTiles.begin()->second->m_raw;
+            locker.unlock();
+            const QByteArray packed = qCompress(QByteArray(reinterpret_cast<const char*>(raw.constBits()),
+                                                           raw.sizeInBytes()), 1);
+            locker.relock();
+            auto it = s.rawTiles.find(sequence);
+            if (it == s.rawTiles.end()) continue;
+            UndoTile *tile = it->second;
+            s.rawTiles.erase(it);
+            s.usage.raw -= tile->m_raw.sizeInBytes();
+            tile->m_raw = QImage();
+            tile->m_packed = packed;
+            s.packedTiles[sequence] = tile;
+            s.usage.compressed += packed.size();
+            continue;
+        }
+        
+        if (!s.needsSpill()) {
+            locker.unlock();
+            compact();
+            continue;
+        }
+        
+        if (!s.file) {
+            s.file.reset(new QTemporaryFile());
+            if (!s.file->open()) {
+                s.file.reset();
+                s.spillFailed = true;
+                continue;
+            }
+        }
+        auto it = s.packedTiles.begin();
+        UndoTile *tile = it->second;
+        s.file->seek(s.fileEnd);
+        if (s.file->write(tile->m_packed) != tile->m_packed.size()) {
+            s.spillFailed = true;
+            continue;
+        }
+        tile->m_fileOffset = s.fileEnd;
+        tile->m_fileLength = tile->m_packed.size();
+        s.fileEnd += tile->m_fileLength;
+        s.spilled += tile->m_fileLength;
+        s.usage.compressed -= tile->m_fileLength;
+        tile->m_packed = QByteArray();
+        s.packedTiles.erase(it);
+        s.spilledTiles[tile->m_fileOffset] = tile;
+    }
+}
+
+void UndoStore::compact()
+{
+    // Slides the live tiles down over the holes in offset order, one tile
+    // per lock so undo never waits on more than a single move.
+    Store &s = ::store();
+    qint64 end = 0;
+    for (;;) {
+        QMutexLocker locker(&s.mutex);
+        auto it = s.spilledTiles.lower_bound(end);
+        if (it == s.spilledTiles.end()) {
+            // Tiles dropped meanwhile may have emptied the file already.
+            s.fileEnd = qMin(end, s.fileEnd);
+            s.file->resize(s.fileEnd);
+            return;
+        }
+        UndoTile *tile = it->second;
+        if (tile->m_fileOffset != end) {
+            s.file->seek(tile->m_fileOffset);
+            const QByteArray bytes = s.file->read(tile->m_fileLength);
+            s.file->seek(end);
+            if (bytes.size() != tile->m_fileLength || s.file->write(bytes) != bytes.size()) {
+                // Keep the file as it is rather than keep failing on it.
+                s.compactable = false;
+                return;
+            }
+            s.spilledTiles.erase(it);
+            tile->m_fileOffset = end;
+            s.spilledTiles[end] = tile;
+        }
+        end += tile->m_fileLength;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef UNDOSTORE_H
+#define UNDOSTORE_H
+
+#include <QImage>
+#include <QByteArray>
+#include <QSharedPointer>
+
+// Pixels of one history tile. Depending on UndoStore's budgets they are
+// kept raw, compressed in memory, or compressed in the spill file;
+// pixels() returns an image in every case, or a null one if the spill
+// file can't be read back. A solid tile holds only its colour.
+class UndoTile
+{
+public:
+    ~UndoTile();
+    
+    UndoTile(const UndoTile &) = delete;
+    UndoTile &operator=(const UndoTile &) = delete;
+    
+    QImage pixels() const;
+    QSize size() const { return m_size; }
+    bool isSolid() const { return m_solid; }
+    QRgb color() const { return m_color; }
+
+private:
+    friend class UndoStore;
+    explicit UndoTile(const QImage &pixels);
+    UndoTile(const QSize &size, QImage::Format format, QRgb color);
+    
+    bool m_solid;
+    QRgb m_color;
+    QImage m_raw;
+    QByteArray m_packed;
+    qint64 m_fileOffset;
+    qint64 m_fileLength;
+    QSize m_size;
+    QImage::Format m_format;
+    quint64 m_sequence;
+};
+
+// Keeps the pixels of every history tile within two thresholds. Raw bytes
+// past the memory budget are compressed, oldest tiles first, on a
+// background thread; once raw plus compressed bytes pass the spill
+// threshold, the oldest compressed tiles move to a temporary file and are
+// read back when undo needs them. The file is compacted in the
+// background whenever its dead space exceeds its live data. Thread-safe.
+class UndoStore
+{
+public:
+    static QSharedPointer<UndoTile> store(const QImage &pixels);
+    // A tile of one colour; costs no pixel memory and counts against
+    // neither budget.
+    static QSharedPointer<UndoTile> storeSolid(const QSize &size, QImage::Format format, QRgb color);
+    
+    static void setMemoryBudget(qint64 bytes);
+    static qint64 memoryBudget();
+    static void setSpillThreshold(qint64 bytes);
+    static qint64 spillThreshold();
+    
+    // Bytes held by raw and compressed tiles, and the spill file's size.
+    struct Usage {
+        qint64 raw = 0;
+        qint64 compressed = 0;
+        qint64 disk = 0;
+        bool spillFailed = false;
+    };
+    static Usage usage();
+    // True when history past the spill threshold can't go to disk because
+    // the spill file failed; the owner should drop old steps.
+    static bool overLimit();
+
+private:
+    friend class UndoTile;
+    static void scheduleTrim();
+    static void trim();
+    static void compact();
+};
+
+#endif // UNDOSTORE_H
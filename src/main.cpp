@@ -1,6 +1,9 @@
 #include <QApplication>
 #include <QStyleFactory>
+#include <QCommandLineParser>
 #include "MainWindow.h"
+#include "TileScheduler.h"
+#include "UndoStore.h"
 
 int main(int argc, char *argv[])
 {
@@ -9,6 +12,20 @@ int main(int argc, char *argv[])
     app.setApplicationVersion("1.0");
     app.setOrganizationName("PhotoEditor");
     
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption threadsOption("threads", "图像处理使用的线程数（0 为自动）", "count", "0");
+    parser.addOption(threadsOption);
+    QCommandLineOption historyMemoryOption("history-memory", "撤销历史未压缩部分的内存上限（MB）", "MB", "512");
+    parser.addOption(historyMemoryOption);
+    QCommandLineOption historySpillOption("history-spill", "撤销历史内存总量超过该值（MB）后写入临时文件", "MB", "1024");
+    parser.addOption(historySpillOption);
+    parser.process(app);
+    TileScheduler::setThreadCount(parser.value(threadsOption).toInt());
+    UndoStore::setMemoryBudget(parser.value(historyMemoryOption).toLongLong() * 1024 * 1024);
+    UndoStore::setSpillThreshold(parser.value(historySpillOption).toLongLong() * 1024 * 1024);
+    
     app.setStyle(QStyleFactory::create("Fusion"));
     
     MainWindow mainWindow;